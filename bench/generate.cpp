@@ -0,0 +1,449 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cxxopts.hpp>
+#include "wrapper/filesystem.h"
+
+namespace {
+struct GeneratorOptions {
+    std::string outputDir, romFile;
+    uint32_t seed;
+    int fontCount, tableCount, filesPerTable, glyphCount;
+    size_t scriptSize;
+};
+
+struct Glyph {
+    std::string text;
+    unsigned int code;
+    int width;
+};
+
+struct Command {
+    const char* name;
+    bool isNewLine;
+};
+
+struct GeneratedFont {
+    std::string name;
+    int byteWidth;
+    bool isWide;
+    std::vector<Glyph> glyphs;
+    std::vector<size_t> wordGlyphs, cjkGlyphs;
+    std::vector<std::string> bracketNames, extras;
+};
+
+const Command COMMANDS[] = {
+    {"End", false},
+    {"NewLine", true},
+    {"ClearFrame", true},
+    {"WaitForA", false},
+    {"SetColor", false},
+    {"ShowPortrait", false},
+    {"Pause", false},
+    {"SwitchFrame", true},
+};
+
+const char* DIGRAPHS[] = {
+    "th", "he", "in", "er", "an", "re", "on", "at", "en", "nd",
+    "ti", "es", "or", "te", "of", "ed", "is", "it", "al", "ar",
+    "st", "to", "nt", "ng", "se", "ha", "as", "ou", "io", "le",
+    "ve", "co", "me", "de", "hi", "ri", "ro", "ic", "ne", "ea",
+    "ll", "e.", "s,", "y!", "e?",
+};
+
+// std::mt19937 output is fully specified, the standard distributions are
+// not, so everything is derived from the raw engine output.
+class Random
+{
+public:
+    Random(uint32_t seed) : m_Engine(seed) {}
+    size_t below(size_t n)
+    {
+        return n > 0 ? m_Engine() % n : 0;
+    }
+    bool chance(int percent)
+    {
+        return below(100) < static_cast<size_t>(percent);
+    }
+    // Picks low indices far more often, like character frequencies in real text.
+    size_t skewed(size_t n)
+    {
+        double u = m_Engine() / 4294967296.0;
+        return std::min(n - 1, static_cast<size_t>(u * u * n));
+    }
+
+private:
+    std::mt19937 m_Engine;
+};
+
+std::string encodeUtf8(char32_t codePoint)
+{
+    std::string out;
+    if (codePoint < 0x80) {
+        out += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    return out;
+}
+
+std::string yamlString(const std::string& value)
+{
+    std::string quoted = "\"";
+    for (char c: value) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+std::string hex(unsigned int value, int digits)
+{
+    std::ostringstream out;
+    out << "0x" << std::hex;
+    out.width(digits);
+    out.fill('0');
+    out << value;
+    return out.str();
+}
+
+// Even fonts after the first are fixed width menu fonts, odd fonts are
+// 2-byte fonts with a large CJK glyph set.
+GeneratedFont buildFont(int index, const GeneratorOptions& options, Random& random)
+{
+    GeneratedFont font;
+    font.name = "font" + std::to_string(index);
+    font.isWide = (index % 2) == 1;
+    font.byteWidth = font.isWide ? 2 : 1;
+    unsigned int code = 1;
+    for (char c = ' '; c <= '~'; c++) {
+        if (c == '#' || c == '[' || c == ']' || c == '@') {
+            continue;
+        }
+        font.glyphs.push_back({std::string(1, c), code++, static_cast<int>(3 + random.below(6))});
+    }
+    // Letters in order of English frequency, so skewed picks look like text.
+    for (char c: std::string("etaoinshrdlcumwfgypbvkjxqzETAOINSHRDLCUMWFGYPBVKJXQZ")) {
+        auto glyph = std::find_if(font.glyphs.begin(), font.glyphs.end(), [c](const Glyph& g) {
+            return g.text.front() == c;
+        });
+        font.wordGlyphs.push_back(glyph - font.glyphs.begin());
+    }
+    if (index == 0 || font.isWide) {
+        for (const char* digraph: DIGRAPHS) {
+            font.glyphs.push_back({digraph, code++, static_cast<int>(6 + random.below(5))});
+        }
+    }
+    if (font.isWide) {
+        font.glyphs.push_back({encodeUtf8(0x3002), code++, 12});
+        for (int i = 0; i < options.glyphCount; i++) {
+            font.cjkGlyphs.push_back(font.glyphs.size());
+            font.glyphs.push_back({encodeUtf8(0x4E00 + i), code++, 12});
+        }
+        // Frequent pairs of the most common characters share one code.
+        for (int i = 0; i + 1 < options.glyphCount && i < 64; i += 2) {
+            font.glyphs.push_back({encodeUtf8(0x4E00 + i) + encodeUtf8(0x4E00 + i + 1), code++, 12});
+        }
+    }
+    for (const char* name: {"Heart", "Note", "Star"}) {
+        font.bracketNames.push_back(name);
+        font.glyphs.push_back({std::string("[") + name + ']', code++, 8});
+    }
+    if (index == 0) {
+        for (int i = 0; i < 10; i++) {
+            font.extras.push_back("Name" + std::to_string(i));
+        }
+    }
+    return font;
+}
+
+void writeFonts(std::ostream& out, const std::vector<GeneratedFont>& fonts)
+{
+    for (size_t index = 0; index < fonts.size(); index++) {
+        const GeneratedFont& font = fonts[index];
+        bool isMenu = index > 0 && !font.isWide;
+        out << font.name << ":\n"
+            << "    HasDigraphs: " << (isMenu ? "false" : "true") << '\n'
+            << "    ByteWidth: " << font.byteWidth << '\n';
+        if (font.isWide) {
+            out << "    FixedWidth: 12\n"
+                << "    MaxWidth: 240\n";
+        } else if (isMenu) {
+            out << "    CommandValue: 0x00\n"
+                << "    FixedWidth: 8\n"
+                << "    MaxWidth: 128\n";
+        } else {
+            out << "    CommandValue: 0x00\n"
+                << "    MaxWidth: 160\n"
+                << "    MaxEncodedValue: " << hex(font.glyphs.back().code, 2) << '\n'
+                << "    FontWidthAddress: \"!" << font.name << "Widths\"\n";
+        }
+        out << "    Encoding:\n";
+        for (auto& glyph: font.glyphs) {
+            out << "        " << yamlString(glyph.text) << ":\n"
+                << "            code: " << hex(glyph.code, font.byteWidth * 2) << '\n';
+            if (!font.isWide && !isMenu) {
+                out << "            length: " << glyph.width << '\n';
+            }
+        }
+        out << "    Commands:\n";
+        for (size_t i = 0; i < std::size(COMMANDS); i++) {
+            unsigned int commandCode = font.isWide ? 0xFFFF - i : i;
+            out << "        " << COMMANDS[i].name << ":\n"
+                << "            code: " << hex(commandCode, font.byteWidth * 2) << '\n';
+            if (COMMANDS[i].isNewLine) {
+                out << "            newline: true\n";
+            }
+        }
+        if (!font.extras.empty()) {
+            out << "    Extras:\n";
+            for (size_t i = 0; i < font.extras.size(); i++) {
+                out << "        " << font.extras[i] << ": " << hex(i, 2) << '\n';
+            }
+        }
+    }
+}
+
+std::string makeWord(const GeneratedFont& font, Random& random)
+{
+    std::string word;
+    if (!font.cjkGlyphs.empty() && !random.chance(10)) {
+        size_t length = 1 + random.below(4);
+        for (size_t i = 0; i < length; i++) {
+            word += font.glyphs[font.cjkGlyphs[random.skewed(font.cjkGlyphs.size())]].text;
+        }
+        return word;
+    }
+    size_t length = 1 + random.below(8);
+    for (size_t i = 0; i < length; i++) {
+        word += font.glyphs[font.wordGlyphs[random.skewed(font.wordGlyphs.size())]].text;
+    }
+    return word;
+}
+
+std::string makeLine(const GeneratedFont& font, Random& random)
+{
+    // A few lines are far over the width limit, as in real unwrapped scripts.
+    size_t words = random.chance(5) ? 40 + random.below(40) : 2 + random.below(6);
+    std::string line;
+    for (size_t i = 0; i < words; i++) {
+        if (i > 0 && font.cjkGlyphs.empty()) {
+            line += ' ';
+        }
+        line += makeWord(font, random);
+        if (random.chance(4)) {
+            line += '[' + font.bracketNames[random.below(font.bracketNames.size())] + ']';
+        } else if (!font.extras.empty() && random.chance(3)) {
+            line += '[' + font.extras[random.below(font.extras.size())] + ']';
+        } else if (random.chance(3)) {
+            line += "[SetColor][$" + std::to_string(1 + random.below(7)) + "]";
+        }
+    }
+    if (random.chance(30)) {
+        line += font.cjkGlyphs.empty() ? (random.chance(50) ? "." : "?") : encodeUtf8(0x3002);
+    }
+    return line;
+}
+
+std::string makeMessage(const GeneratedFont& font, const std::string& label, Random& random)
+{
+    std::string message = "@label " + label + '\n';
+    if (random.chance(10)) {
+        message += "@printpc\n";
+    }
+    if (random.chance(5)) {
+        message += "@width off\n";
+    }
+    size_t lines = 1 + random.below(5);
+    for (size_t i = 0; i < lines; i++) {
+        message += makeLine(font, random);
+        if (i + 1 == lines) {
+            message += "[End]";
+        } else if (random.chance(15)) {
+            message += random.chance(50) ? "[WaitForA]\n[ClearFrame]" : "[Pause]";
+        }
+        message += '\n';
+    }
+    return message;
+}
+
+void writeFile(const fs::path& path, const std::string& data)
+{
+    std::ofstream output(path.string(), std::ios::out | std::ios::binary);
+    if (!output) {
+        throw std::runtime_error("Could not open " + path.string() + " for writing.");
+    }
+    output.write(data.data(), data.size());
+}
+
+size_t parseSize(const std::string& value)
+{
+    size_t end;
+    double number = std::stod(value, &end);
+    std::string suffix = value.substr(end);
+    if (suffix == "k" || suffix == "K") {
+        number *= 1024;
+    } else if (suffix == "m" || suffix == "M") {
+        number *= 1024 * 1024;
+    } else if (suffix == "g" || suffix == "G") {
+        number *= 1024 * 1024 * 1024;
+    } else if (!suffix.empty()) {
+        throw std::runtime_error("Unknown size suffix \"" + suffix + "\".");
+    }
+    return static_cast<size_t>(number);
+}
+
+void generate(const GeneratorOptions& options)
+{
+    Random random(options.seed);
+    fs::path root(options.outputDir);
+    fs::path mainDir = root / "project";
+    fs::create_directories(root / "config");
+    fs::create_directories(root / "roms");
+    fs::create_directories(mainDir / "text");
+    fs::create_directories(mainDir / "asm" / "bin" / "fonts");
+
+    std::vector<GeneratedFont> fonts;
+    for (int i = 0; i < options.fontCount; i++) {
+        fonts.push_back(buildFont(i, options, random));
+    }
+    {
+        std::ostringstream mapping;
+        writeFonts(mapping, fonts);
+        writeFile(root / "config" / "in.yml", mapping.str());
+    }
+
+    std::string romName;
+    if (!options.romFile.empty()) {
+        romName = fs::path(options.romFile).filename().string();
+        fs::copy_file(options.romFile, root / "roms" / romName, fs::copy_options::overwrite_existing);
+    }
+    {
+        std::ostringstream config;
+        config << "files:\n"
+                  "    mainDir: project\n"
+                  "    input:\n"
+                  "        directory: text\n"
+                  "    output:\n"
+                  "        directory: asm\n"
+                  "        binaries:\n"
+                  "            mainDir: bin\n"
+                  "            textDir: text\n"
+                  "            fonts:\n"
+                  "                dir: fonts\n"
+                  "                includes: []\n"
+                  "    romDir: roms\n"
+                  "config:\n"
+                  "    directory: config\n"
+                  "    inMapping: in.yml\n"
+                  "    defaultMode: font0\n";
+        if (romName.empty()) {
+            config << "roms: []\n";
+        } else {
+            config << "roms:\n"
+                      "    - name: \"generated\"\n"
+                      "      file: " << yamlString(romName) << "\n"
+                      "      header: auto\n";
+        }
+        writeFile(root / "config.yml", config.str());
+    }
+
+    // Tables start at $A08000 and each one gets the banks its text needs.
+    size_t fileCount = static_cast<size_t>(options.tableCount) * options.filesPerTable;
+    size_t fileSize = std::max<size_t>(1, options.scriptSize / std::max<size_t>(1, fileCount));
+    size_t totalSize = 0;
+    unsigned int bank = 0xA0;
+    for (int table = 0; table < options.tableCount; table++) {
+        std::string dirName = "table" + std::to_string(table);
+        fs::path dir = mainDir / "text" / dirName;
+        fs::create_directories(dir);
+        std::vector<std::string> labels;
+        size_t tableSize = 0;
+        for (int file = 0; file < options.filesPerTable; file++) {
+            std::string fileName = std::to_string(file) + ".txt";
+            const GeneratedFont& font = fonts[random.chance(60) ? 0 : random.below(fonts.size())];
+            std::string script;
+            if (&font != &fonts.front()) {
+                script += "@type " + font.name + '\n';
+            }
+            while (script.size() < fileSize) {
+                std::string label = dirName + '_' + std::to_string(file) + '_' + std::to_string(labels.size());
+                script += makeMessage(font, label, random);
+                labels.push_back(label);
+            }
+            tableSize += script.size();
+            writeFile(dir / fileName, script);
+        }
+        std::ostringstream tableFile;
+        tableFile << "address $" << std::hex << (bank << 16 | 0x8000) << std::dec << '\n'
+                  << "width 3\n\n";
+        for (int file = 0; file < options.filesPerTable; file++) {
+            tableFile << "file " << file << ".txt\n";
+        }
+        tableFile << '\n';
+        for (auto& label: labels) {
+            tableFile << "entry " << label << '\n';
+        }
+        writeFile(dir / "table.txt", tableFile.str());
+        totalSize += tableSize;
+        bank += 1 + (tableSize + labels.size() * 3) / 0x8000;
+    }
+    if (bank > 0x100) {
+        std::cerr << "Warning: the generated text needs more space than a LoROM image has,"
+                     " so only parsing can be measured with it.\n";
+    }
+    std::cerr << "Wrote " << totalSize << " bytes of script in " << fileCount
+              << " files to " << root.string() << '\n';
+}
+}
+
+int main(int argc, char * argv[])
+{
+    cxxopts::Options programOptions(
+                argv[0],
+                "Generate a complete Sable project of a given size for load testing.");
+    programOptions.add_options()
+            ("o,output", "Directory to write the project to.", cxxopts::value<std::string>(), "DIR")
+            ("seed", "Random seed, the same seed and options give the same project.", cxxopts::value<uint32_t>()->default_value("1"), "N")
+            ("f,fonts", "Number of fonts, every second one is a 2-byte font.", cxxopts::value<int>()->default_value("3"), "N")
+            ("g,glyphs", "Number of CJK glyphs in each 2-byte font, up to 60000.", cxxopts::value<int>()->default_value("3000"), "N")
+            ("t,tables", "Number of table directories.", cxxopts::value<int>()->default_value("4"), "N")
+            ("files", "Number of script files in each table.", cxxopts::value<int>()->default_value("16"), "N")
+            ("s,size", "Total script size, with an optional K, M or G suffix.", cxxopts::value<std::string>()->default_value("1M"), "SIZE")
+            ("r,rom", "ROM to copy into the project and add to the roms section.", cxxopts::value<std::string>(), "FILE")
+            ("h,help", "Show this message.");
+    auto options = programOptions.parse(argc, argv);
+    if (options.count("h") > 0 || options.count("output") == 0) {
+        std::cout << programOptions.help({""}) << '\n';
+        return options.count("h") > 0 ? 0 : 1;
+    }
+    try {
+        GeneratorOptions generatorOptions;
+        generatorOptions.outputDir = options["output"].as<std::string>();
+        generatorOptions.romFile = options.count("rom") > 0 ? options["rom"].as<std::string>() : "";
+        generatorOptions.seed = options["seed"].as<uint32_t>();
+        generatorOptions.fontCount = std::max(1, options["fonts"].as<int>());
+        generatorOptions.glyphCount = std::min(std::max(1, options["glyphs"].as<int>()), 60000);
+        generatorOptions.tableCount = std::max(1, options["tables"].as<int>());
+        generatorOptions.filesPerTable = std::max(1, options["files"].as<int>());
+        generatorOptions.scriptSize = parseSize(options["size"].as<std::string>());
+        generate(generatorOptions);
+    } catch (std::exception &e) {
+        std::cerr << "Could not generate project:\n" << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
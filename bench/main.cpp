@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cxxopts.hpp>
+#include <yaml-cpp/yaml.h>
+#include "wrapper/filesystem.h"
+#include "cache.h"
+#include "exceptions.h"
+#include "mappedfile.h"
+#include "parse.h"
+#include "project.h"
+#include "table.h"
+#include "util.h"
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+struct BenchOptions {
+    int runs;
+    bool warm, parseOnly, assemble, inMemory, link;
+    unsigned int jobs;
+};
+
+struct RunResult {
+    std::vector<std::pair<std::string, double>> phases;
+    size_t bytes = 0, messages = 0;
+};
+
+class PhaseTimer
+{
+public:
+    PhaseTimer(RunResult& result) : m_Result(result), m_Start(Clock::now()) {}
+    void lap(const std::string& phase)
+    {
+        auto now = Clock::now();
+        m_Result.phases.push_back({phase, std::chrono::duration<double, std::milli>(now - m_Start).count()});
+        m_Start = now;
+    }
+
+private:
+    RunResult& m_Result;
+    Clock::time_point m_Start;
+};
+
+// Runs the same steps as the sable executable through Project.
+RunResult runProject(const std::string& dir, const BenchOptions& options, sable::Cache* cache)
+{
+    RunResult result;
+    PhaseTimer timer(result);
+    sable::Project project(dir);
+    project.setWriteOutput(!options.inMemory);
+    project.setLinkOutput(options.link);
+    project.setThreadCount(options.jobs);
+    timer.lap("load");
+    // Also writes the font data, as it does for the sable executable.
+    project.parseText(cache);
+    timer.lap("parseText");
+    if (options.assemble) {
+        // Keep Asar's status lines out of the JSON report.
+        std::ostringstream discarded;
+        auto* buffer = std::cout.rdbuf(discarded.rdbuf());
+        try {
+            project.writePatchData();
+        } catch (...) {
+            std::cout.rdbuf(buffer);
+            throw;
+        }
+        std::cout.rdbuf(buffer);
+        timer.lap("writePatchData");
+    }
+    result.bytes = project.getScriptSize();
+    result.messages = project.getMessageCount();
+    return result;
+}
+
+// Encodes every script with TextParser, Font and Table alone, without
+// writing any output.
+RunResult runParseOnly(const std::string& dir)
+{
+    using sable::Project;
+    RunResult result;
+    PhaseTimer timer(result);
+    fs::path projectDir(dir);
+    YAML::Node config = YAML::LoadFile((projectDir / "config.yml").string());
+    fs::path mainDir = config[Project::FILES_SECTION][Project::DIR_MAIN].as<std::string>();
+    if (mainDir.is_relative()) {
+        mainDir = projectDir / mainDir;
+    }
+    fs::path input = mainDir / config[Project::FILES_SECTION][Project::INPUT_SECTION][Project::DIR_VAL].as<std::string>();
+    fs::path fontLocation = projectDir
+            / config[Project::CONFIG_SECTION][Project::DIR_VAL].as<std::string>()
+            / config[Project::CONFIG_SECTION][Project::IN_MAP].as<std::string>();
+    std::string defaultMode = config[Project::CONFIG_SECTION][Project::DEFAULT_MODE].IsDefined()
+            ? config[Project::CONFIG_SECTION][Project::DEFAULT_MODE].as<std::string>() : "normal";
+    sable::TextParser parser(YAML::LoadFile(fontLocation.string()), defaultMode);
+    timer.lap("load");
+
+    std::vector<std::string> files;
+    std::vector<fs::path> dirs;
+    std::copy(fs::directory_iterator(input), fs::directory_iterator(), std::back_inserter(dirs));
+    std::sort(dirs.begin(), dirs.end());
+    for (auto& tableDir: dirs) {
+        if (!fs::is_directory(tableDir)) {
+            continue;
+        }
+        std::vector<std::string> dirFiles;
+        if (fs::exists(tableDir / "table.txt")) {
+            std::ifstream tableFile((tableDir / "table.txt").string());
+            sable::Table table;
+            for (auto& file: table.getDataFromFile(tableFile)) {
+                dirFiles.push_back((tableDir / file).string());
+            }
+        } else {
+            for (auto& fileIt: fs::directory_iterator(tableDir)) {
+                if (fs::is_regular_file(fileIt.path())) {
+                    dirFiles.push_back(fileIt.path().string());
+                }
+            }
+        }
+        std::sort(dirFiles.begin(), dirFiles.end());
+        files.insert(files.end(), dirFiles.begin(), dirFiles.end());
+    }
+    timer.lap("tables");
+
+    std::vector<unsigned char> data;
+    for (auto& file: files) {
+        sable::MappedFile script(file);
+        result.bytes += script.size();
+        sable::ParseSettings settings = parser.getDefaultSetting(-1);
+        parser.parseBuffer(script.data(), settings, std::back_inserter(data), [&](bool done, int, int) {
+            if (done && !data.empty()) {
+                result.messages++;
+                data.clear();
+            }
+        });
+    }
+    timer.lap("parse");
+    return result;
+}
+
+double percentile(std::vector<double> values, double fraction)
+{
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    return values[std::min(rank, values.size() - 1)];
+}
+
+std::string jsonString(const std::string& value)
+{
+    std::string escaped;
+    sable::util::appendJsonString(escaped, value);
+    return escaped;
+}
+
+void writeStats(std::ostream& out, const std::vector<double>& values)
+{
+    double total = 0;
+    for (double value: values) {
+        total += value;
+    }
+    out << "{\"median\": " << percentile(values, 0.5)
+        << ", \"p90\": " << percentile(values, 0.9)
+        << ", \"p99\": " << percentile(values, 0.99)
+        << ", \"min\": " << *std::min_element(values.begin(), values.end())
+        << ", \"max\": " << *std::max_element(values.begin(), values.end())
+        << ", \"mean\": " << total / values.size() << '}';
+}
+
+void writeReport(std::ostream& out, const std::string& dir, const BenchOptions& options, const std::vector<RunResult>& runs)
+{
+    std::vector<std::string> phaseNames;
+    std::map<std::string, std::vector<double>> phases;
+    std::vector<double> totals;
+    for (auto& run: runs) {
+        double total = 0;
+        for (auto& phase: run.phases) {
+            if (phases.find(phase.first) == phases.end()) {
+                phaseNames.push_back(phase.first);
+            }
+            phases[phase.first].push_back(phase.second);
+            total += phase.second;
+        }
+        totals.push_back(total);
+    }
+    double medianSeconds = percentile(totals, 0.5) / 1000.0;
+    const RunResult& last = runs.back();
+    out << "    {\n"
+        << "      \"project\": " << jsonString(dir) << ",\n"
+        << "      \"mode\": " << (options.parseOnly ? "\"parse\"" : "\"full\"") << ",\n"
+        << "      \"warm\": " << (options.warm ? "true" : "false") << ",\n"
+        << "      \"runs\": " << runs.size() << ",\n"
+        << "      \"bytes\": " << last.bytes << ",\n"
+        << "      \"messages\": " << last.messages << ",\n"
+        << "      \"mbPerSecond\": " << (medianSeconds > 0 ? last.bytes / 1048576.0 / medianSeconds : 0) << ",\n"
+        << "      \"messagesPerSecond\": " << (medianSeconds > 0 ? last.messages / medianSeconds : 0) << ",\n"
+        << "      \"phases\": {\n";
+    for (size_t i = 0; i < phaseNames.size(); i++) {
+        out << "        " << jsonString(phaseNames[i]) << ": ";
+        writeStats(out, phases[phaseNames[i]]);
+        out << (i + 1 < phaseNames.size() ? ",\n" : "\n");
+    }
+    out << "      },\n"
+        << "      \"total\": ";
+    writeStats(out, totals);
+    out << "\n    }";
+}
+}
+
+int main(int argc, char * argv[])
+{
+    using std::cerr;
+    cxxopts::Options programOptions(
+                argv[0],
+                "Benchmark Sable builds and report the time spent in each phase as JSON.");
+    programOptions.add_options()
+            ("p,project", "Project directory to benchmark, may be given more than once.", cxxopts::value<std::vector<std::string>>(), "DIR")
+            ("n,runs", "Number of timed runs per project.", cxxopts::value<int>()->default_value("5"), "N")
+            ("w,warm", "Run once untimed first and reuse the parse cache between runs.")
+            ("parse-only", "Only encode the scripts, using the parser directly.")
+            ("s,no-assembly", "Skip writePatchData.")
+            ("m,in-memory", "Do not write generated files to disk.")
+            ("l,link", "Write text into the ROM directly instead of assembling it.")
+            ("j,jobs", "Number of threads and patcher processes - defaults to one per core.", cxxopts::value<unsigned int>()->default_value("0"), "N")
+            ("o,output", "Write the report to a file instead of standard output.", cxxopts::value<std::string>(), "FILE")
+            ("h,help", "Show this message.");
+    programOptions.parse_positional({"project"});
+    auto options = programOptions.parse(argc, argv);
+    if (options.count("h") > 0 || options.count("project") == 0) {
+        std::cout << programOptions.help({""}) << '\n';
+        return options.count("h") > 0 ? 0 : 1;
+    }
+    BenchOptions benchOptions;
+    benchOptions.runs = std::max(1, options["runs"].as<int>());
+    benchOptions.warm = options.count("warm") > 0;
+    benchOptions.parseOnly = options.count("parse-only") > 0;
+    benchOptions.assemble = options.count("no-assembly") == 0;
+    benchOptions.inMemory = options.count("in-memory") > 0;
+    benchOptions.link = options.count("link") > 0;
+    benchOptions.jobs = options["jobs"].as<unsigned int>();
+
+    std::ofstream outputFile;
+    if (options.count("output") > 0) {
+        outputFile.open(options["output"].as<std::string>());
+        if (!outputFile) {
+            cerr << "Could not open " << options["output"].as<std::string>() << " for writing." << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = outputFile.is_open() ? outputFile : std::cout;
+    std::vector<std::string> projects = options["project"].as<std::vector<std::string>>();
+    out << "{\n  \"results\": [\n";
+    for (size_t i = 0; i < projects.size(); i++) {
+        const std::string& dir = projects[i];
+        std::vector<RunResult> runs;
+        try {
+            sable::Cache cache(dir);
+            sable::Cache* runCache = benchOptions.warm ? &cache : nullptr;
+            int total = benchOptions.runs + (benchOptions.warm ? 1 : 0);
+            for (int run = 0; run < total; run++) {
+                RunResult result = benchOptions.parseOnly ? runParseOnly(dir) : runProject(dir, benchOptions, runCache);
+                if (!benchOptions.warm || run > 0) {
+                    runs.push_back(result);
+                }
+            }
+        } catch (std::exception &e) {
+            cerr << "Benchmark of " << dir << " failed:\n" << e.what() << std::endl;
+            return 1;
+        }
+        writeReport(out, dir, benchOptions, runs);
+        out << (i + 1 < projects.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}" << std::endl;
+    return 0;
+}
@@ -44,6 +44,8 @@ if (SABLE_BUILD_TESTS)
                 WORKING_DIRECTORY ${CMAKE_CURRENT_SOURCE_DIR})
 endif()
 
+find_package(Threads REQUIRED)
+
 set(SABLE_LIBRARIES "")
 
 list(
@@ -51,4 +53,5 @@ list(
 
     yaml-cpp
     asar
+    Threads::Threads
 )
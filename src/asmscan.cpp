@@ -0,0 +1,146 @@
+#include "asmscan.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include "wrapper/filesystem.h"
+
+namespace {
+const char* const ROM_WORDS[] = {
+    "freespace", "freecode", "freedata", "autoclean", "prot", "check",
+    "read1", "read2", "read3", "read4",
+    "canread", "canread1", "canread2", "canread3", "canread4"
+};
+// Only commands, so these only count at the start of a statement.
+const char* const STATE_WORDS[] = {
+    "lorom", "hirom", "exlorom", "exhirom", "sa1rom", "fullsa1rom", "sfxrom", "norom",
+    "arch", "namespace", "base", "bank", "dpbase", "optimize", "math", "check",
+    "table", "cleartable", "pushtable", "padbyte", "padword", "padlong",
+    "fillbyte", "fillword", "filllong"
+};
+
+bool isWordChar(char c)
+{
+    return std::isalnum((unsigned char)c) || c == '_';
+}
+
+template<size_t N>
+bool contains(const char* const (&words)[N], const std::string& word)
+{
+    return std::find(std::begin(words), std::end(words), word) != std::end(words);
+}
+
+bool readSource(const fs::path& path, const sable::MemoryFiles& files, std::string& source)
+{
+    auto file = files.find(path.string());
+    if (file != files.end()) {
+        source = file->second;
+        return true;
+    }
+    std::ifstream input(path, std::ios::in | std::ios::binary);
+    if (!input) {
+        return false;
+    }
+    source.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    return true;
+}
+
+int scanFile(const fs::path& path, const sable::MemoryFiles& files, std::set<std::string>& visited)
+{
+    if (!visited.insert(path.string()).second) {
+        return 0;
+    }
+    std::string source;
+    if (!readSource(path, files, source)) {
+        return sable::UNKNOWN_SOURCE;
+    }
+    int found = 0;
+    size_t lineStart = 0;
+    while (lineStart < source.size()) {
+        size_t lineEnd = source.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = source.size();
+        }
+        std::string line = source.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        // 'a' = $00 maps a character for every string after it.
+        size_t first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && line[first] == '\'') {
+            size_t close = line.find('\'', first + 1);
+            size_t next = close == std::string::npos ? close : line.find_first_not_of(" \t", close + 1);
+            if (next != std::string::npos && line[next] == '=') {
+                found |= sable::SETS_STATE;
+            }
+        }
+        char quote = 0;
+        bool statementStart = true;
+        for (size_t i = 0; i < line.size(); i++) {
+            char c = line[i];
+            if (quote != 0) {
+                if (c == quote) {
+                    quote = 0;
+                }
+                continue;
+            } else if (c == ';') {
+                break;
+            } else if (c == '"' || c == '\'') {
+                quote = c;
+                statementStart = false;
+            } else if (c == ':') {
+                statementStart = true;
+            } else if (c == '?' && i + 1 < line.size() && line[i + 1] == '=') {
+                found |= sable::CHECKS_DEFINES;
+            } else if (isWordChar(c)) {
+                size_t end = i;
+                while (end < line.size() && isWordChar(line[end])) {
+                    end++;
+                }
+                std::string word = line.substr(i, end - i);
+                std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) {
+                    return std::tolower(c);
+                });
+                // Defines, sublabels and macro calls share names with commands.
+                bool named = i > 0 && (line[i - 1] == '!' || line[i - 1] == '.' || line[i - 1] == '%');
+                if (!named) {
+                    if (contains(ROM_WORDS, word)) {
+                        found |= sable::READS_ROM;
+                    } else if (word == "defined") {
+                        found |= sable::CHECKS_DEFINES;
+                    }
+                    if (statementStart && contains(STATE_WORDS, word)) {
+                        found |= sable::SETS_STATE;
+                    } else if (statementStart && word == "incsrc") {
+                        size_t argStart = line.find_first_not_of(" \t", end);
+                        size_t argEnd = argStart == std::string::npos ? argStart : line.find(';', argStart);
+                        std::string argument = argStart == std::string::npos
+                                ? std::string() : line.substr(argStart, argEnd - argStart);
+                        argument.erase(argument.find_last_not_of(" \t\r") + 1);
+                        if (argument.size() >= 2 && argument.front() == '"' && argument.back() == '"') {
+                            argument = argument.substr(1, argument.size() - 2);
+                        }
+                        if (argument.empty() || argument.find('!') != std::string::npos) {
+                            found |= sable::UNKNOWN_SOURCE;
+                        } else {
+                            fs::path included = (path.parent_path() / argument).lexically_normal();
+                            found |= scanFile(included, files, visited);
+                        }
+                        break;
+                    }
+                }
+                statementStart = false;
+                i = end - 1;
+            } else if (c != ' ' && c != '\t') {
+                statementStart = false;
+            }
+        }
+    }
+    return found;
+}
+}
+
+int sable::scanAsmDependencies(const std::string &path, const MemoryFiles &files)
+{
+    std::set<std::string> visited;
+    return scanFile(fs::absolute(path).lexically_normal(), files, visited);
+}
@@ -0,0 +1,28 @@
+#ifndef ASMSCAN_H
+#define ASMSCAN_H
+
+#include "rompatcher.h"
+#include <string>
+
+namespace sable {
+// Ways the result of assembling part of a patch can depend on what is
+// assembled around it. Found by looking for the statements that do so, so
+// a match in code that never runs still counts.
+enum AsmDependency {
+    // freespace, autoclean, read1() and the like look at the ROM itself.
+    READS_ROM = 1,
+    // ?= and defined() change what they do depending on earlier defines.
+    CHECKS_DEFINES = 2,
+    // Mapper, arch, namespace, base, table and other settings that the
+    // code after it inherits.
+    SETS_STATE = 4,
+    // An incsrc that could not be followed.
+    UNKNOWN_SOURCE = 8
+};
+
+// Scans a patch and everything it includes with incsrc, looking files up in
+// the memory files before the disk as Asar does. Returns AsmDependency flags.
+int scanAsmDependencies(const std::string& path, const MemoryFiles& files);
+}
+
+#endif // ASMSCAN_H
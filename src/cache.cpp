@@ -1,7 +1,16 @@
 #include "cache.h"
+#include "util.h"
 #include <fstream>
+#include <cstring>
+#include <iterator>
+#include <unordered_set>
 
-sable::Cache::Cache(const std::string& path) : m_MaxAddress(0), m_IsReadable(false)
+using sable::util::writeValue;
+using sable::util::writeString;
+using sable::util::readValue;
+using sable::util::readSequence;
+
+sable::Cache::Cache(const std::string& path) : m_MaxAddress(0), m_IsReadable(false), m_InputHash(0)
 {
     if (path.empty()) {
         m_CacheFile = fs::path("cache") / "cache.bin";
@@ -11,12 +20,69 @@ sable::Cache::Cache(const std::string& path) : m_MaxAddress(0), m_IsReadable(fal
 
     if (fs::exists(m_CacheFile)) {
         std::ifstream input(m_CacheFile.string(), std::ios::binary);
-        input.read(reinterpret_cast<char*>(&m_MaxAddress), sizeof (int));
+        std::string data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
         input.close();
+        if (!readDatabase(data)) {
+            // unknown version or damaged file, only the max address of the
+            // original format is worth keeping.
+            m_Files.clear();
+            m_InputHash = 0;
+            if (data.compare(0, std::strlen(MAGIC), MAGIC) != 0 && data.size() >= sizeof (int)) {
+                std::memcpy(&m_MaxAddress, data.data(), sizeof (int));
+            }
+        }
         m_IsReadable = true;
     }
 }
 
+bool sable::Cache::readDatabase(std::string_view data)
+{
+    uint32_t version, fileCount;
+    if (data.compare(0, std::strlen(MAGIC), MAGIC) != 0) {
+        return false;
+    }
+    data.remove_prefix(std::strlen(MAGIC));
+    if (!readValue(data, version) || version != VERSION
+            || !readValue(data, m_MaxAddress)
+            || !readValue(data, m_InputHash)
+            || !readValue(data, fileCount)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < fileCount; i++) {
+        std::string file;
+        FileEntry entry;
+        uint32_t messageCount, warningCount;
+        if (!readSequence(data, file) || !readValue(data, entry.hash) || !readValue(data, messageCount)) {
+            return false;
+        }
+        entry.encoded.messages.resize(messageCount);
+        for (EncodedMessage& message: entry.encoded.messages) {
+            unsigned char printpc;
+            if (!readSequence(data, message.label)
+                    || !readValue(data, message.address)
+                    || !readValue(data, printpc)
+                    || !readSequence(data, message.data)) {
+                return false;
+            }
+            message.printpc = printpc != 0;
+        }
+        if (!readValue(data, warningCount)) {
+            return false;
+        }
+        entry.encoded.warnings.resize(warningCount);
+        for (std::string& warning: entry.encoded.warnings) {
+            if (!readSequence(data, warning)) {
+                return false;
+            }
+        }
+        if (!readValue(data, entry.encoded.endAddress)) {
+            return false;
+        }
+        m_Files[file] = std::move(entry);
+    }
+    return data.empty();
+}
+
 int sable::Cache::getMaxAddress() const
 {
     if (m_IsReadable) {
@@ -32,6 +98,49 @@ void sable::Cache::setMaxAddress(int value)
     m_IsReadable = true;
 }
 
+void sable::Cache::setInputHash(uint64_t hash)
+{
+    if (hash != m_InputHash) {
+        m_Files.clear();
+        m_InputHash = hash;
+    }
+}
+
+const sable::EncodedFile* sable::Cache::findFile(const std::string &file, uint64_t hash) const
+{
+    auto it = m_Files.find(file);
+    if (it == m_Files.end() || it->second.hash != hash) {
+        return nullptr;
+    }
+    return &it->second.encoded;
+}
+
+void sable::Cache::storeFile(const std::string &file, uint64_t hash, const EncodedFile &encoded)
+{
+    if (encoded.error) {
+        m_Files.erase(file);
+    } else {
+        m_Files[file] = {hash, encoded};
+    }
+}
+
+void sable::Cache::keepFiles(const std::vector<std::string> &files)
+{
+    std::unordered_set<std::string> keep(files.begin(), files.end());
+    for (auto it = m_Files.begin(); it != m_Files.end();) {
+        if (keep.count(it->first) == 0) {
+            it = m_Files.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t sable::Cache::getFileCount() const
+{
+    return m_Files.size();
+}
+
 bool sable::Cache::isReadable() const
 {
     return m_IsReadable;
@@ -46,8 +155,29 @@ bool sable::Cache::write() const
         if (fs::is_directory(m_CacheFile.parent_path())) {
             std::ofstream cacheOutFile(m_CacheFile.string(), std::ios::binary);
             if (cacheOutFile) {
-                int maxWrite = m_MaxAddress;
-                cacheOutFile.write(reinterpret_cast<char*>(&maxWrite), sizeof (int));
+                std::string data(MAGIC);
+                writeValue(data, VERSION);
+                writeValue(data, m_MaxAddress);
+                writeValue(data, m_InputHash);
+                writeValue<uint32_t>(data, m_Files.size());
+                for (auto& [file, entry]: m_Files) {
+                    writeString(data, file);
+                    writeValue(data, entry.hash);
+                    writeValue<uint32_t>(data, entry.encoded.messages.size());
+                    for (const EncodedMessage& message: entry.encoded.messages) {
+                        writeString(data, message.label);
+                        writeValue(data, message.address);
+                        writeValue<unsigned char>(data, message.printpc);
+                        writeString(data, std::string_view(
+                                        reinterpret_cast<const char*>(message.data.data()), message.data.size()));
+                    }
+                    writeValue<uint32_t>(data, entry.encoded.warnings.size());
+                    for (const std::string& warning: entry.encoded.warnings) {
+                        writeString(data, warning);
+                    }
+                    writeValue(data, entry.encoded.endAddress);
+                }
+                cacheOutFile.write(data.data(), data.size());
                 cacheOutFile.close();
                 return true;
             }
@@ -1,24 +1,45 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "wrapper/filesystem.h"
+#include "parse.h"
 
 namespace sable {
 class Cache
 {
 static constexpr const int MAX_ADDR = 0;
 public:
+    static constexpr const char* MAGIC = "SBLC";
+    static constexpr const uint32_t VERSION = 3;
+
     Cache(const std::string& path = "");
     int getMaxAddress() const;
     void setMaxAddress(int value);
 
+    void setInputHash(uint64_t hash);
+    const EncodedFile* findFile(const std::string& file, uint64_t hash) const;
+    void storeFile(const std::string& file, uint64_t hash, const EncodedFile& encoded);
+    void keepFiles(const std::vector<std::string>& files);
+    size_t getFileCount() const;
+
     bool isReadable() const;
     bool write() const;
 
 private:
+    struct FileEntry {
+        uint64_t hash;
+        EncodedFile encoded;
+    };
     int m_MaxAddress;
     bool m_IsReadable;
+    uint64_t m_InputHash;
+    std::unordered_map<std::string, FileEntry> m_Files;
     fs::path m_CacheFile;
+    bool readDatabase(std::string_view data);
 };
 }
 
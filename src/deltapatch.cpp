@@ -0,0 +1,343 @@
+#include "deltapatch.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SABLE_CRC32_PCLMUL
+#include <immintrin.h>
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace {
+constexpr size_t IPS_EOF = 0x454F46;
+constexpr size_t IPS_MAX_OFFSET = 0xFFFFFF;
+constexpr size_t IPS_MAX_RECORD = 0xFFFF;
+// Runs of one byte at least this long are written as a run instead of literally.
+constexpr size_t IPS_MIN_RUN = 9;
+constexpr size_t BPS_MIN_RUN = 6;
+enum BpsAction {SOURCE_READ, TARGET_READ, SOURCE_COPY, TARGET_COPY};
+
+typedef std::array<std::array<uint32_t, 256>, 8> CrcTables;
+
+CrcTables makeCrcTables()
+{
+    CrcTables tables;
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+        tables[0][i] = crc;
+    }
+    for (size_t table = 1; table < tables.size(); table++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            tables[table][i] = (tables[table - 1][i] >> 8) ^ tables[0][tables[table - 1][i] & 0xFF];
+        }
+    }
+    return tables;
+}
+
+uint32_t readLittle32(const unsigned char* data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Slicing-by-8 on the inverted CRC.
+uint32_t crc32Tables(const unsigned char* data, size_t length, uint32_t crc)
+{
+    static const CrcTables tables = makeCrcTables();
+    for (; length >= 8; data += 8, length -= 8) {
+        uint32_t one = readLittle32(data) ^ crc;
+        uint32_t two = readLittle32(data + 4);
+        crc = tables[7][one & 0xFF] ^ tables[6][(one >> 8) & 0xFF]
+                ^ tables[5][(one >> 16) & 0xFF] ^ tables[4][one >> 24]
+                ^ tables[3][two & 0xFF] ^ tables[2][(two >> 8) & 0xFF]
+                ^ tables[1][(two >> 16) & 0xFF] ^ tables[0][two >> 24];
+    }
+    for (; length > 0; data++, length--) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *data) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef SABLE_CRC32_PCLMUL
+// Folds 64 bytes at a time with carry-less multiplication and reduces the
+// result with Barrett reduction, on the inverted CRC. Needs at least 64 bytes
+// and only reads whole 16 byte blocks, which are returned in done.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32Pclmul(const unsigned char* data, size_t length, uint32_t crc, size_t& done)
+{
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+    const unsigned char* start = data;
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+    data += 64;
+    length -= 64;
+    for (; length >= 64; data += 64, length -= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)));
+    }
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+    for (__m128i next: {x2, x3, x4}) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+    }
+    for (; length >= 16; data += 16, length -= 16) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data))), x5);
+    }
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, x3), x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    done = data - start;
+    return _mm_extract_epi32(x1, 1);
+}
+#endif
+
+// Adds the bytes past the end of the base ROM and merges overlapping ranges.
+sable::ByteRanges normalizeRanges(std::string_view source, std::string_view target, const sable::ByteRanges& changed)
+{
+    sable::ByteRanges ranges;
+    ranges.reserve(changed.size() + 1);
+    for (auto& range: changed) {
+        size_t end = std::min(range.second, target.size());
+        if (range.first < end) {
+            ranges.emplace_back(range.first, end);
+        }
+    }
+    if (source.size() < target.size()) {
+        ranges.emplace_back(source.size(), target.size());
+    }
+    std::sort(ranges.begin(), ranges.end());
+    sable::ByteRanges merged;
+    for (auto& range: ranges) {
+        if (!merged.empty() && range.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, range.second);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    return merged;
+}
+
+// Calls write with each block of bytes that differ from the base ROM. Fewer
+// than minGap equal bytes do not end a block.
+template<typename Writer>
+void forEachDifference(std::string_view source, std::string_view target, const sable::ByteRanges& ranges, size_t minGap, Writer write)
+{
+    auto differs = [&](size_t i) {
+        return i >= source.size() || source[i] != target[i];
+    };
+    for (auto& range: ranges) {
+        size_t position = range.first;
+        while (position < range.second) {
+            if (!differs(position)) {
+                position++;
+                continue;
+            }
+            size_t end = position + 1;
+            for (size_t i = end; i < range.second && i - end < minGap; i++) {
+                if (differs(i)) {
+                    end = i + 1;
+                }
+            }
+            write(position, end);
+            position = end;
+        }
+    }
+}
+
+size_t runLength(std::string_view target, size_t position, size_t end)
+{
+    size_t run = position + 1;
+    while (run < end && target[run] == target[position]) {
+        run++;
+    }
+    return run - position;
+}
+
+void appendBigEndian(std::string& out, size_t value, int bytes)
+{
+    while (bytes-- > 0) {
+        out += (char)(value >> (8 * bytes));
+    }
+}
+
+void appendLittle32(std::string& out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out += (char)(value >> (8 * i));
+    }
+}
+
+void appendBpsNumber(std::string& out, uint64_t value)
+{
+    while (true) {
+        unsigned char low = value & 0x7F;
+        value >>= 7;
+        if (value == 0) {
+            out += (char)(0x80 | low);
+            break;
+        }
+        out += (char)low;
+        value--;
+    }
+}
+}
+
+uint32_t sable::crc32(std::string_view data, uint32_t crc)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    size_t length = data.size();
+    crc = ~crc;
+#if defined(__ARM_FEATURE_CRC32)
+    for (; length >= 8; bytes += 8, length -= 8) {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; i--) {
+            value = (value << 8) | bytes[i];
+        }
+        crc = __crc32d(crc, value);
+    }
+#elif defined(SABLE_CRC32_PCLMUL)
+    static const bool hasPclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    if (hasPclmul && length >= 64) {
+        size_t done;
+        crc = crc32Pclmul(bytes, length, crc, done);
+        bytes += done;
+        length -= done;
+    }
+#endif
+    return ~crc32Tables(bytes, length, crc);
+}
+
+std::string sable::makeIpsPatch(std::string_view source, std::string_view target, const ByteRanges &changed)
+{
+    if (target.size() > IPS_MAX_OFFSET + 1) {
+        throw std::runtime_error("ROM is too large for an IPS patch.");
+    }
+    std::string patch = "PATCH";
+    // A record can not start at the offset that reads as "EOF", so it starts
+    // one byte earlier instead.
+    auto writeLiteral = [&](size_t start, size_t end) {
+        while (start < end) {
+            if (start == IPS_EOF) {
+                start--;
+            }
+            size_t length = std::min(end - start, IPS_MAX_RECORD);
+            appendBigEndian(patch, start, 3);
+            appendBigEndian(patch, length, 2);
+            patch.append(target.substr(start, length));
+            start += length;
+        }
+    };
+    auto writeRun = [&](size_t start, size_t length) {
+        if (start == IPS_EOF) {
+            writeLiteral(start, start + 1);
+            start++;
+            length--;
+        }
+        if (length > 0) {
+            appendBigEndian(patch, start, 3);
+            appendBigEndian(patch, 0, 2);
+            appendBigEndian(patch, length, 2);
+            patch += target[start];
+        }
+    };
+    forEachDifference(source, target, normalizeRanges(source, target, changed), 6, [&](size_t start, size_t end) {
+        size_t literal = start;
+        for (size_t position = start; position < end;) {
+            size_t run = runLength(target, position, std::min(end, position + IPS_MAX_RECORD));
+            if (run >= IPS_MIN_RUN) {
+                writeLiteral(literal, position);
+                writeRun(position, run);
+                literal = position + run;
+            }
+            position += run;
+        }
+        writeLiteral(literal, end);
+    });
+    patch += "EOF";
+    if (target.size() < source.size()) {
+        appendBigEndian(patch, target.size(), 3);
+    }
+    return patch;
+}
+
+std::string sable::makeBpsPatch(std::string_view source, std::string_view target, const ByteRanges &changed)
+{
+    std::string patch = "BPS1";
+    appendBpsNumber(patch, source.size());
+    appendBpsNumber(patch, target.size());
+    appendBpsNumber(patch, 0);
+    size_t output = 0, targetRelative = 0;
+    auto writeAction = [&](BpsAction action, size_t length) {
+        appendBpsNumber(patch, ((uint64_t)(length - 1) << 2) | action);
+    };
+    // Everything outside the changed ranges is the same in both ROMs.
+    auto sourceRead = [&](size_t end) {
+        if (output < end) {
+            writeAction(SOURCE_READ, end - output);
+            output = end;
+        }
+    };
+    auto targetRead = [&](size_t end) {
+        if (output < end) {
+            writeAction(TARGET_READ, end - output);
+            patch.append(target.substr(output, end - output));
+            output = end;
+        }
+    };
+    forEachDifference(source, target, normalizeRanges(source, target, changed), 4, [&](size_t start, size_t end) {
+        sourceRead(start);
+        for (size_t position = start; position < end;) {
+            size_t run = runLength(target, position, end);
+            if (run >= BPS_MIN_RUN) {
+                // The first byte of the run is read, and the rest copies the
+                // byte before it.
+                targetRead(position + 1);
+                writeAction(TARGET_COPY, run - 1);
+                int64_t delta = (int64_t)position - (int64_t)targetRelative;
+                appendBpsNumber(patch, ((uint64_t)(delta < 0 ? -delta : delta) << 1) | (delta < 0));
+                targetRelative = position + run - 1;
+                output = position + run;
+            }
+            position += run;
+        }
+        targetRead(end);
+    });
+    sourceRead(target.size());
+    appendLittle32(patch, crc32(source));
+    appendLittle32(patch, crc32(target));
+    appendLittle32(patch, crc32(patch));
+    return patch;
+}
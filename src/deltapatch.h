@@ -0,0 +1,22 @@
+#ifndef DELTAPATCH_H
+#define DELTAPATCH_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace sable {
+// Byte ranges [first, second) of a ROM file that may differ from the base ROM.
+// Everything outside them has to be equal in both files.
+typedef std::vector<std::pair<size_t, size_t>> ByteRanges;
+
+uint32_t crc32(std::string_view data, uint32_t crc = 0);
+// Both patches only look at the changed ranges, plus the bytes past the end
+// of the base ROM, so they are made without diffing the whole ROM.
+std::string makeIpsPatch(std::string_view source, std::string_view target, const ByteRanges& changed);
+std::string makeBpsPatch(std::string_view source, std::string_view target, const ByteRanges& changed);
+}
+
+#endif // DELTAPATCH_H
@@ -0,0 +1,170 @@
+#include "dictionary.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+struct Entry {
+    std::string text;
+    std::vector<unsigned int> glyphs;
+    int width;
+};
+
+// Runs task(first, last, worker) on up to threadCount threads, each with its
+// own contiguous part of [0, count).
+template <class Task>
+void forEachChunk(size_t count, unsigned int threadCount, Task&& task)
+{
+    threadCount = std::max<size_t>(1, std::min<size_t>(threadCount, count));
+    size_t chunk = (count + threadCount - 1) / threadCount;
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threadCount; i++) {
+        workers.emplace_back(task, std::min(count, i * chunk), std::min(count, (i + 1) * chunk), i);
+    }
+    task(0, std::min(count, chunk), 0);
+    for (auto& thread: workers) {
+        thread.join();
+    }
+}
+
+uint64_t pairKey(uint32_t first, uint32_t second)
+{
+    return (static_cast<uint64_t>(first) << 32) | second;
+}
+}
+
+namespace sable {
+
+std::vector<Font::DictionaryEntry> buildDictionary(const Font& font, const std::vector<std::string>& runs, unsigned int threadCount)
+{
+    std::vector<Font::DictionaryEntry> dictionary;
+    std::vector<unsigned int> codes = font.getDictionaryCodes();
+    size_t maxLength = font.getDictionaryEntryLength();
+    if (codes.empty() || maxLength < 2) {
+        return dictionary;
+    }
+    threadCount = std::max(threadCount, 1u);
+
+    // Split every run into entries of the font, numbering each distinct text.
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, uint32_t> entryIds;
+    std::vector<std::vector<uint32_t>> sequences;
+    for (const std::string& run: runs) {
+        std::vector<uint32_t> sequence;
+        const char* first = run.data();
+        const char* last = first + run.size();
+        while (first != last) {
+            unsigned int code;
+            int width;
+            size_t matched;
+            try {
+                std::tie(code, width, matched) = font.matchText(first, last);
+            } catch (std::runtime_error&) {
+                // Text the font cannot encode breaks the run; encoding reports it later.
+                if (sequence.size() > 1) {
+                    sequences.push_back(std::move(sequence));
+                }
+                sequence.clear();
+                ++first;
+                continue;
+            }
+            std::string text(first, matched);
+            auto id = entryIds.emplace(text, entries.size());
+            if (id.second) {
+                entries.push_back({std::move(text), {code}, width});
+            }
+            sequence.push_back(id.first->second);
+            first += matched;
+        }
+        if (sequence.size() > 1) {
+            sequences.push_back(std::move(sequence));
+        }
+    }
+
+    size_t nextCode = 0;
+    while (nextCode < codes.size()) {
+        // Count adjacent pairs that still fit an entry. A run of one repeated
+        // entry only counts the pairs that can be replaced without overlap.
+        std::vector<std::unordered_map<uint64_t, uint32_t>> counts(threadCount);
+        forEachChunk(sequences.size(), threadCount, [&](size_t first, size_t last, unsigned int worker) {
+            auto& local = counts[worker];
+            for (size_t i = first; i < last; i++) {
+                const std::vector<uint32_t>& sequence = sequences[i];
+                bool counted = false;
+                for (size_t j = 0; j + 1 < sequence.size(); j++) {
+                    uint32_t a = sequence[j], b = sequence[j + 1];
+                    if (counted && a == b && sequence[j - 1] == a) {
+                        counted = false;
+                        continue;
+                    }
+                    counted = entries[a].glyphs.size() + entries[b].glyphs.size() <= maxLength;
+                    if (counted) {
+                        local[pairKey(a, b)]++;
+                    }
+                }
+            }
+        });
+        for (unsigned int i = 1; i < threadCount; i++) {
+            for (auto& count: counts[i]) {
+                counts[0][count.first] += count.second;
+            }
+        }
+        std::vector<std::pair<uint32_t, uint64_t>> candidates;
+        for (auto& count: counts[0]) {
+            if (count.second > 1) {
+                candidates.emplace_back(count.second, count.first);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+        // Join the most frequent pairs that share no entry, so replacing them
+        // in one pass gives the same result as one at a time.
+        std::vector<bool> used(entries.size(), false);
+        std::unordered_map<uint64_t, uint32_t> joined;
+        for (auto& candidate: candidates) {
+            if (nextCode == codes.size()) {
+                break;
+            }
+            uint32_t a = candidate.second >> 32, b = candidate.second & 0xFFFFFFFF;
+            if (used[a] || used[b]) {
+                continue;
+            }
+            std::string text = entries[a].text + entries[b].text;
+            if (entryIds.count(text) > 0 || font.findSymbol(text) != nullptr) {
+                continue;
+            }
+            used[a] = used[b] = true;
+            Entry entry = {text, entries[a].glyphs, entries[a].width + entries[b].width};
+            entry.glyphs.insert(entry.glyphs.end(), entries[b].glyphs.begin(), entries[b].glyphs.end());
+            joined[candidate.second] = entries.size();
+            entryIds[text] = entries.size();
+            dictionary.push_back({codes[nextCode++], entry.text, entry.glyphs, entry.width});
+            entries.push_back(std::move(entry));
+        }
+        if (joined.empty()) {
+            break;
+        }
+        forEachChunk(sequences.size(), threadCount, [&](size_t first, size_t last, unsigned int) {
+            for (size_t i = first; i < last; i++) {
+                std::vector<uint32_t>& sequence = sequences[i];
+                size_t out = 0;
+                for (size_t j = 0; j < sequence.size(); out++) {
+                    auto pair = j + 1 < sequence.size() ? joined.find(pairKey(sequence[j], sequence[j + 1])) : joined.end();
+                    if (pair != joined.end()) {
+                        sequence[out] = pair->second;
+                        j += 2;
+                    } else {
+                        sequence[out] = sequence[j++];
+                    }
+                }
+                sequence.resize(out);
+            }
+        });
+    }
+    return dictionary;
+}
+}
@@ -0,0 +1,17 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <string>
+#include <vector>
+#include "font.h"
+
+namespace sable {
+// Chooses dictionary entries for the spare codes of a font from the plain
+// text runs of a script. Runs are split into the font's encoding, then the
+// most frequent pairs of adjacent entries are repeatedly joined into new
+// entries until the codes run out or no pair occurs more than once.
+// The font must not have a dictionary installed yet.
+std::vector<Font::DictionaryEntry> buildDictionary(const Font& font, const std::vector<std::string>& runs, unsigned int threadCount);
+}
+
+#endif // DICTIONARY_H
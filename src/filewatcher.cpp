@@ -0,0 +1,168 @@
+#include "filewatcher.h"
+#include <algorithm>
+#include <set>
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+namespace sable {
+
+#ifdef __linux__
+FileWatcher::FileWatcher() : m_Fd(inotify_init1(IN_CLOEXEC))
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (m_Fd >= 0) {
+        close(m_Fd);
+    }
+}
+#else
+FileWatcher::FileWatcher()
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+}
+#endif
+
+void FileWatcher::addDirectory(const std::string &path, bool recursive)
+{
+    std::string directory = fs::absolute(path).lexically_normal().string();
+    if (!fs::is_directory(directory)) {
+        return;
+    }
+    auto known = m_Directories.find(directory);
+    if (known != m_Directories.end() && (known->second || !recursive)) {
+        return;
+    }
+    m_Directories[directory] = recursive;
+#ifdef __linux__
+    watch(directory, recursive);
+#else
+    m_Times = scan();
+#endif
+}
+
+#ifdef __linux__
+void FileWatcher::watch(const std::string &path, bool recursive)
+{
+    int wd = inotify_add_watch(m_Fd, path.c_str(), IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+    if (wd < 0) {
+        return;
+    }
+    Watch& watch = m_Watches[wd];
+    watch.path = path;
+    watch.recursive |= recursive;
+    if (recursive) {
+        for (auto& entry: fs::directory_iterator(path)) {
+            if (fs::is_directory(entry.path())) {
+                this->watch(entry.path().string(), true);
+            }
+        }
+    }
+}
+
+std::vector<std::string> FileWatcher::wait(int quietMs)
+{
+    // Block until something changes, then keep collecting until nothing has
+    // changed for quietMs, so an editor saving several files causes one build.
+    std::set<std::string> changed;
+    int timeout = -1;
+    while (m_Fd >= 0) {
+        pollfd descriptor = {m_Fd, POLLIN, 0};
+        int ready = poll(&descriptor, 1, timeout);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        } else if (ready <= 0) {
+            break;
+        }
+        alignas(inotify_event) char buffer[16384];
+        ssize_t length = read(m_Fd, buffer, sizeof (buffer));
+        if (length <= 0) {
+            continue;
+        }
+        for (char* it = buffer; it < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(it);
+            it += sizeof (inotify_event) + event->len;
+            auto watch = m_Watches.find(event->wd);
+            if (watch == m_Watches.end()) {
+                continue;
+            } else if ((event->mask & IN_IGNORED) != 0) {
+                m_Watches.erase(watch);
+                continue;
+            } else if (event->len == 0) {
+                continue;
+            }
+            std::string path = (fs::path(watch->second.path) / event->name).string();
+            if ((event->mask & IN_ISDIR) != 0 && (event->mask & (IN_CREATE | IN_MOVED_TO)) != 0 && watch->second.recursive) {
+                this->watch(path, true);
+            }
+            changed.insert(path);
+        }
+        if (!changed.empty()) {
+            timeout = quietMs;
+        }
+    }
+    return std::vector<std::string>(changed.begin(), changed.end());
+}
+#else
+std::map<std::string, FileWatcher::FileTime> FileWatcher::scan() const
+{
+    std::map<std::string, FileTime> times;
+    for (auto& directory: m_Directories) {
+        auto add = [&times](const fs::path& path) {
+            try {
+                times[path.string()] = fs::last_write_time(path);
+            } catch (fs::filesystem_error&) {
+                // Removed while scanning, the next scan reports it.
+            }
+        };
+        if (directory.second) {
+            for (auto& entry: fs::recursive_directory_iterator(directory.first)) {
+                add(entry.path());
+            }
+        } else {
+            for (auto& entry: fs::directory_iterator(directory.first)) {
+                add(entry.path());
+            }
+        }
+    }
+    return times;
+}
+
+std::vector<std::string> FileWatcher::wait(int quietMs)
+{
+    std::set<std::string> changed;
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(changed.empty() ? 200 : quietMs));
+        std::map<std::string, FileTime> times = scan();
+        size_t found = changed.size();
+        for (auto& time: times) {
+            auto previous = m_Times.find(time.first);
+            if (previous == m_Times.end() || previous->second != time.second) {
+                changed.insert(time.first);
+            }
+        }
+        for (auto& time: m_Times) {
+            if (times.count(time.first) == 0) {
+                changed.insert(time.first);
+            }
+        }
+        m_Times = std::move(times);
+        if (!changed.empty() && changed.size() == found) {
+            break;
+        }
+    }
+    return std::vector<std::string>(changed.begin(), changed.end());
+}
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "wrapper/filesystem.h"
+
+namespace sable {
+// Waits for files in a set of directories to be written, created, removed or
+// renamed. Uses inotify on Linux and compares modification times elsewhere.
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+    void addDirectory(const std::string& path, bool recursive);
+    std::vector<std::string> wait(int quietMs = 30);
+
+private:
+    std::map<std::string, bool> m_Directories;
+#ifdef __linux__
+    struct Watch {
+        std::string path;
+        bool recursive;
+    };
+    int m_Fd;
+    std::map<int, Watch> m_Watches;
+    void watch(const std::string& path, bool recursive);
+#else
+    typedef decltype(fs::last_write_time(fs::path())) FileTime;
+    std::map<std::string, FileTime> m_Times;
+    std::map<std::string, FileTime> scan() const;
+#endif
+};
+}
+
+#endif // FILEWATCHER_H
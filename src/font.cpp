@@ -1,6 +1,12 @@
 #include "font.h"
 #include "exceptions.h"
+#include "util.h"
 #include <exception>
+#include <algorithm>
+#include <map>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace sable {
 
@@ -13,14 +19,27 @@ namespace sable {
                 return val;
             });
             try {
-                m_TextConvertMap = generateMap<TextNode>(config[ENCODING], ENCODING, [](std::string& str) {
+                std::vector<std::string> bracketed;
+                m_TextConvertMap = generateMap<TextNode>(config[ENCODING], ENCODING, [&bracketed](std::string& str) {
+                        bool isBracketed = false;
                         if (str.front() == '[') {
                             str.erase(0,1);
+                            isBracketed = true;
                         }
                         if (str.back() == ']') {
                             str.pop_back();
+                            isBracketed = true;
+                        }
+                        if (isBracketed) {
+                            bracketed.push_back(str);
                         }
                     });
+                for (auto& name: bracketed) {
+                    auto text = m_TextConvertMap.find(name);
+                    if (text != m_TextConvertMap.end()) {
+                        text->second.isBracketed = true;
+                    }
+                }
             } catch(YAML::TypedBadConversion<int> &e) {
                 throw FontError(e.mark, m_Name, TEXT_LENGTH_VAL, "an integer.");
             } catch(YAML::TypedBadConversion<unsigned int> &e) {
@@ -65,6 +84,35 @@ namespace sable {
                     m_MaxEncodedValue |= (0xFF << i);
                 }
             }
+            if (config[DICTIONARY].IsDefined()) {
+                const YAML::Node dictionary = config[DICTIONARY];
+                if (!dictionary.IsMap()) {
+                    throw FontError(dictionary.Mark(), m_Name, DICTIONARY, "a map.");
+                }
+                m_DictionaryLocation = validate<std::string>(dictionary[DICT_ADDR_VAL], DICT_ADDR_VAL);
+                std::vector<int> codes;
+                try {
+                    codes = dictionary[DICT_CODES_VAL].as<std::vector<int>>();
+                } catch (YAML::InvalidNode &e) {
+                    throw FontError(e.mark, m_Name, DICT_CODES_VAL);
+                } catch (YAML::BadConversion &e) {
+                    throw FontError(e.mark, m_Name, DICT_CODES_VAL, "a sequence of two integers.");
+                }
+                if (codes.size() != 2 || codes[0] < 0 || codes[0] > codes[1] || codes[1] > m_MaxEncodedValue) {
+                    throw FontError(dictionary[DICT_CODES_VAL].Mark(), m_Name, DICT_CODES_VAL, "a first and last code no greater than " + std::to_string(m_MaxEncodedValue) + ".");
+                }
+                m_DictionaryFirst = codes[0];
+                m_DictionaryLast = codes[1];
+                m_DictionaryEntryLength = dictionary[DICT_LENGTH_VAL].IsDefined() ? validate<int>(dictionary[DICT_LENGTH_VAL], DICT_LENGTH_VAL, [] (const int& val) {
+                    if (val < 2 || val > 255) {
+                        throw std::runtime_error("between 2 and 255.");
+                    }
+                    return val;
+                }) : 2;
+            }
+            buildTrie();
+            buildGlyphTables();
+            buildSymbolTable();
             m_IsValid = true;
             try {
                  endValue = m_CommandConvertMap.at("End").code;
@@ -74,49 +122,163 @@ namespace sable {
 
     }
 
-    unsigned int Font::getCommandCode(const std::string &id) const
+    unsigned int Font::getCommandCode(std::string_view id) const
     {
-        if (m_CommandConvertMap.find(id) == m_CommandConvertMap.end()) {
+        auto command = m_CommandConvertMap.find(id);
+        if (command == m_CommandConvertMap.end()) {
             throw std::runtime_error("");
         }
-        return m_CommandConvertMap.at(id).code;
+        return command->second.code;
     }
 
-    std::tuple<unsigned int, bool> Font::getTextCode(const std::string &id, const std::string& next) const
+    std::tuple<unsigned int, bool> Font::getTextCode(std::string_view id, std::string_view next) const
     {
-        if (!next.empty() && m_TextConvertMap.find(id + next) != m_TextConvertMap.end()) {
-            return std::make_tuple(m_TextConvertMap.at(id + next).code, true);
-        } else if (m_TextConvertMap.find(id) == m_TextConvertMap.end()) {
+        if (!next.empty()) {
+            auto digraph = m_TextConvertMap.find(std::string(id).append(next));
+            if (digraph != m_TextConvertMap.end()) {
+                return std::make_tuple(digraph->second.code, true);
+            }
+        }
+        auto text = m_TextConvertMap.find(id);
+        if (text == m_TextConvertMap.end()) {
+            throw std::runtime_error(std::string(id) + " not found in " + ENCODING + " of font " + m_Name);
+        }
+        return std::make_tuple(text->second.code, false);
+    }
+
+    std::tuple<unsigned int, int, size_t> Font::matchText(const char *first, const char *last) const
+    {
+        // Without digraphs or a dictionary only a single UTF-8 sequence may be matched.
+        if (!matchesSequences() && first != last) {
+            size_t sequence = utf8SequenceLength(*first);
+            if (static_cast<size_t>(last - first) > sequence) {
+                last = first + sequence;
+            }
+        }
+        const TrieNode* accepted = nullptr;
+        size_t matched = 0;
+        if (first != last && !m_Trie.empty()) {
+            int index = m_TrieRoot[static_cast<unsigned char>(*first)];
+            const char* it = first + 1;
+            while (index >= 0) {
+                const TrieNode& node = m_Trie[index];
+                if (node.isTerminal) {
+                    accepted = &node;
+                    matched = it - first;
+                }
+                if (it == last) {
+                    break;
+                }
+                index = findTrieChild(index, *(it++));
+            }
+        }
+        if (accepted == nullptr) {
+            std::string id(first, first == last ? first : first + std::min<size_t>(utf8SequenceLength(*first), last - first));
             throw std::runtime_error(id + " not found in " + ENCODING + " of font " + m_Name);
         }
-        return std::make_tuple(m_TextConvertMap.at(id).code, false);
+        return std::make_tuple(accepted->code, accepted->width, matched);
     }
 
-    int Font::getExtraValue(const std::string &id) const
+    size_t Font::encodeRun(const char *first, const char *last, int &width, std::back_insert_iterator<std::vector<unsigned char>> inserter) const
     {
-        if (m_Extras.find(id) == m_Extras.end()) {
+        const char* it = first;
+        width = 0;
+        if (m_Trie.empty()) {
+            return 0;
+        }
+        while (it != last) {
+#if defined(__SSE2__)
+            // Encode whole blocks of 16 ASCII characters when none of them need the trie.
+            while (last - it >= 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+                if (_mm_movemask_epi8(block) != 0) {
+                    break;
+                }
+                const Glyph* glyphs[16];
+                bool isSimple = true;
+                for (int i = 0; i < 16; i++) {
+                    glyphs[i] = &m_AsciiGlyphs[static_cast<unsigned char>(it[i])];
+                    isSimple &= glyphs[i]->isSimple;
+                }
+                if (!isSimple) {
+                    break;
+                }
+                for (int i = 0; i < 16; i++) {
+                    unsigned int code = glyphs[i]->code;
+                    for (int byte = 0; byte < m_ByteWidth; byte++) {
+                        *(inserter++) = (code & 0xFF);
+                        code >>= 8;
+                    }
+                    width += glyphs[i]->width;
+                }
+                it += 16;
+            }
+            if (it == last) {
+                break;
+            }
+#endif
+            const Glyph* glyph;
+            size_t length;
+            unsigned char lead = static_cast<unsigned char>(*it);
+            if (lead < 0x80) {
+                glyph = &m_AsciiGlyphs[lead];
+                length = 1;
+            } else {
+                char32_t codePoint;
+                length = decodeUtf8(it, last, codePoint);
+                glyph = length > 0 ? findGlyph(codePoint) : nullptr;
+            }
+            if (glyph == nullptr || !glyph->isSimple) {
+                break;
+            }
+            unsigned int code = glyph->code;
+            for (int byte = 0; byte < m_ByteWidth; byte++) {
+                *(inserter++) = (code & 0xFF);
+                code >>= 8;
+            }
+            width += glyph->width;
+            it += length;
+        }
+        return it - first;
+    }
+
+    int Font::getExtraValue(std::string_view id) const
+    {
+        auto extra = m_Extras.find(id);
+        if (extra == m_Extras.end()) {
             throw std::runtime_error("");
         }
-        return m_Extras.at(id);
+        return extra->second;
     }
 
-    int Font::getWidth(const std::string &id) const
+    const Font::Symbol* Font::findSymbol(std::string_view id) const
     {
-        if (m_TextConvertMap.find(id) == m_TextConvertMap.end()) {
-            throw std::runtime_error(id + " not found in " + COMMANDS + " of font " + m_Name);
-        } else if (m_IsFixedWidth || m_TextConvertMap.at(id).width <= 0) {
+        auto symbol = m_Symbols.find(id);
+        if (symbol == m_Symbols.end()) {
+            return nullptr;
+        }
+        return &symbol->second;
+    }
+
+    int Font::getWidth(std::string_view id) const
+    {
+        auto text = m_TextConvertMap.find(id);
+        if (text == m_TextConvertMap.end()) {
+            throw std::runtime_error(std::string(id) + " not found in " + COMMANDS + " of font " + m_Name);
+        } else if (m_IsFixedWidth || text->second.width <= 0) {
             return m_DefaultWidth;
         } else {
-            return m_TextConvertMap.at(id).width;
+            return text->second.width;
         }
     }
 
-    bool Font::isCommandNewline(const std::string &id) const
+    bool Font::isCommandNewline(std::string_view id) const
     {
-        if (m_CommandConvertMap.find(id) == m_CommandConvertMap.end()) {
-            throw std::runtime_error(id + " not found in " + COMMANDS + " of font " + m_Name);
+        auto command = m_CommandConvertMap.find(id);
+        if (command == m_CommandConvertMap.end()) {
+            throw std::runtime_error(std::string(id) + " not found in " + COMMANDS + " of font " + m_Name);
         }
-        return m_CommandConvertMap.at(id).isNewLine;
+        return command->second.isNewLine;
     }
 
     void Font::getFontWidths(std::back_insert_iterator<std::vector<int> > inserter) const
@@ -153,6 +315,291 @@ namespace sable {
         }
     }
 
+    bool Font::matchesSequences() const
+    {
+        return m_HasDigraphs || !m_Dictionary.empty();
+    }
+
+    bool Font::isPlainText(const std::string &name, const TextNode &text) const
+    {
+        // Text outside brackets is a single character, or a digraph of two.
+        if (name.empty() || text.isBracketed) {
+            return false;
+        }
+        size_t first = utf8SequenceLength(name.front());
+        if (first >= name.size()) {
+            return true;
+        }
+        return m_HasDigraphs && first + utf8SequenceLength(name[first]) >= name.size();
+    }
+
+    void Font::buildTrie()
+    {
+        std::vector<std::map<unsigned char, unsigned int>> children(1);
+        std::vector<TrieNode> nodes(1);
+        auto insert = [&](const std::string& text, unsigned int code, int width) {
+            unsigned int index = 0;
+            for (char c: text) {
+                unsigned char byte = static_cast<unsigned char>(c);
+                auto child = children[index].find(byte);
+                if (child == children[index].end()) {
+                    children[index][byte] = nodes.size();
+                    index = nodes.size();
+                    children.emplace_back();
+                    nodes.emplace_back();
+                } else {
+                    index = child->second;
+                }
+            }
+            nodes[index].isTerminal = true;
+            nodes[index].code = code;
+            nodes[index].width = width;
+        };
+        for (auto& entry: m_TextConvertMap) {
+            if (isPlainText(entry.first, entry.second)) {
+                insert(entry.first, entry.second.code, (m_IsFixedWidth || entry.second.width <= 0) ? m_DefaultWidth : entry.second.width);
+            }
+        }
+        for (auto& entry: m_Dictionary) {
+            insert(entry.text, entry.code, entry.width);
+        }
+        m_TrieEdges.clear();
+        for (size_t i = 0; i < nodes.size(); i++) {
+            nodes[i].firstEdge = m_TrieEdges.size();
+            nodes[i].edgeCount = children[i].size();
+            for (auto& child: children[i]) {
+                m_TrieEdges.push_back({child.first, child.second});
+            }
+        }
+        m_TrieRoot.fill(-1);
+        for (auto& child: children[0]) {
+            m_TrieRoot[child.first] = child.second;
+        }
+        m_Trie = std::move(nodes);
+    }
+
+    void Font::buildGlyphTables()
+    {
+        m_AsciiGlyphs.fill(Glyph());
+        m_GlyphPageIndex.fill(0);
+        m_GlyphPages.clear();
+        for (auto& entry: m_TextConvertMap) {
+            char32_t codePoint;
+            const char* first = entry.first.data();
+            const char* last = first + entry.first.size();
+            if (!isPlainText(entry.first, entry.second) || decodeUtf8(first, last, codePoint) != entry.first.size()
+                    || codePoint >= GLYPH_PAGE_SIZE * m_GlyphPageIndex.size()) {
+                continue;
+            }
+            // Characters that begin a longer entry have to go through the trie.
+            int index = m_TrieRoot[static_cast<unsigned char>(*first)];
+            for (const char* it = first + 1; it != last; ++it) {
+                index = findTrieChild(index, *it);
+            }
+            Glyph glyph = {m_Trie[index].code, m_Trie[index].width, !matchesSequences() || m_Trie[index].edgeCount == 0};
+            if (codePoint < m_AsciiGlyphs.size()) {
+                m_AsciiGlyphs[codePoint] = glyph;
+                continue;
+            }
+            unsigned short& page = m_GlyphPageIndex[codePoint / GLYPH_PAGE_SIZE];
+            if (page == 0) {
+                m_GlyphPages.resize(m_GlyphPages.size() + GLYPH_PAGE_SIZE);
+                page = m_GlyphPages.size() / GLYPH_PAGE_SIZE;
+            }
+            m_GlyphPages[(page - 1) * GLYPH_PAGE_SIZE + (codePoint % GLYPH_PAGE_SIZE)] = glyph;
+        }
+        // These characters are reserved by the script syntax and are never plain text.
+        for (char reserved: {'#', '[', '@'}) {
+            m_AsciiGlyphs[reserved].isSimple = false;
+        }
+    }
+
+    void Font::writeImage(std::string &out) const
+    {
+        using util::writeValue;
+        using util::writeString;
+        writeString(out, m_Name);
+        writeValue<unsigned char>(out, m_HasDigraphs);
+        writeValue<unsigned char>(out, m_IsFixedWidth);
+        writeValue(out, m_ByteWidth);
+        writeValue(out, m_CommandValue);
+        writeValue(out, m_MaxWidth);
+        writeValue(out, m_MaxEncodedValue);
+        writeValue(out, m_DefaultWidth);
+        writeValue(out, endValue);
+        writeString(out, m_FontWidthLocation);
+        writeString(out, m_DictionaryLocation);
+        writeValue(out, m_DictionaryFirst);
+        writeValue(out, m_DictionaryLast);
+        writeValue(out, m_DictionaryEntryLength);
+        writeValue<uint32_t>(out, m_TextConvertMap.size());
+        for (auto& text: m_TextConvertMap) {
+            writeString(out, text.first);
+            writeValue(out, text.second.code);
+            writeValue(out, text.second.width);
+            writeValue<unsigned char>(out, text.second.isBracketed);
+        }
+        writeValue<uint32_t>(out, m_CommandConvertMap.size());
+        for (auto& command: m_CommandConvertMap) {
+            writeString(out, command.first);
+            writeValue(out, command.second.code);
+            writeValue<unsigned char>(out, command.second.isNewLine);
+        }
+        writeValue<uint32_t>(out, m_Extras.size());
+        for (auto& extra: m_Extras) {
+            writeString(out, extra.first);
+            writeValue(out, extra.second);
+        }
+    }
+
+    bool Font::readImage(std::string_view &in)
+    {
+        using util::readValue;
+        using util::readSequence;
+        unsigned char hasDigraphs, isFixedWidth;
+        uint32_t count;
+        m_IsValid = false;
+        if (!readSequence(in, m_Name)
+                || !readValue(in, hasDigraphs)
+                || !readValue(in, isFixedWidth)
+                || !readValue(in, m_ByteWidth)
+                || !readValue(in, m_CommandValue)
+                || !readValue(in, m_MaxWidth)
+                || !readValue(in, m_MaxEncodedValue)
+                || !readValue(in, m_DefaultWidth)
+                || !readValue(in, endValue)
+                || !readSequence(in, m_FontWidthLocation)
+                || !readSequence(in, m_DictionaryLocation)
+                || !readValue(in, m_DictionaryFirst)
+                || !readValue(in, m_DictionaryLast)
+                || !readValue(in, m_DictionaryEntryLength)
+                || !readValue(in, count)) {
+            return false;
+        }
+        m_HasDigraphs = hasDigraphs != 0;
+        m_IsFixedWidth = isFixedWidth != 0;
+        m_TextConvertMap.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            std::string name;
+            TextNode text;
+            unsigned char isBracketed;
+            if (!readSequence(in, name) || !readValue(in, text.code) || !readValue(in, text.width)
+                    || !readValue(in, isBracketed)) {
+                return false;
+            }
+            text.isBracketed = isBracketed != 0;
+            m_TextConvertMap.emplace_hint(m_TextConvertMap.end(), std::move(name), text);
+        }
+        m_CommandConvertMap.clear();
+        if (!readValue(in, count)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            std::string name;
+            CommandNode command;
+            unsigned char isNewLine;
+            if (!readSequence(in, name) || !readValue(in, command.code) || !readValue(in, isNewLine)) {
+                return false;
+            }
+            command.isNewLine = isNewLine != 0;
+            m_CommandConvertMap.emplace_hint(m_CommandConvertMap.end(), std::move(name), command);
+        }
+        m_Extras.clear();
+        if (!readValue(in, count)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            std::string name;
+            int value;
+            if (!readSequence(in, name) || !readValue(in, value)) {
+                return false;
+            }
+            m_Extras.emplace_hint(m_Extras.end(), std::move(name), value);
+        }
+        m_Dictionary.clear();
+        buildTrie();
+        buildGlyphTables();
+        buildSymbolTable();
+        m_IsValid = true;
+        return true;
+    }
+
+    void Font::buildSymbolTable()
+    {
+        // Bracketed names resolve to a command first, then text, then an extra.
+        m_Symbols.clear();
+        for (auto& extra: m_Extras) {
+            m_Symbols[extra.first] = {EXTRA, static_cast<unsigned int>(extra.second), 0, false};
+        }
+        for (auto& text: m_TextConvertMap) {
+            int width = (m_IsFixedWidth || text.second.width <= 0) ? m_DefaultWidth : text.second.width;
+            m_Symbols[text.first] = {TEXT, text.second.code, width, false};
+        }
+        for (auto& command: m_CommandConvertMap) {
+            m_Symbols[command.first] = {COMMAND, command.second.code, 0, command.second.isNewLine};
+        }
+    }
+
+    int Font::findTrieChild(int node, char byte) const
+    {
+        auto edgeStart = m_TrieEdges.begin() + m_Trie[node].firstEdge;
+        auto edgeEnd = edgeStart + m_Trie[node].edgeCount;
+        unsigned char value = static_cast<unsigned char>(byte);
+        auto edge = std::lower_bound(edgeStart, edgeEnd, value, [](const TrieEdge& e, unsigned char b) {
+            return e.byte < b;
+        });
+        if (edge == edgeEnd || edge->byte != value) {
+            return -1;
+        }
+        return edge->target;
+    }
+
+    const Font::Glyph *Font::findGlyph(char32_t codePoint) const
+    {
+        if (codePoint < m_AsciiGlyphs.size() || codePoint >= GLYPH_PAGE_SIZE * m_GlyphPageIndex.size()) {
+            return nullptr;
+        }
+        unsigned short page = m_GlyphPageIndex[codePoint / GLYPH_PAGE_SIZE];
+        if (page == 0) {
+            return nullptr;
+        }
+        return &m_GlyphPages[(page - 1) * GLYPH_PAGE_SIZE + (codePoint % GLYPH_PAGE_SIZE)];
+    }
+
+    size_t Font::decodeUtf8(const char *first, const char *last, char32_t &codePoint)
+    {
+        size_t length = utf8SequenceLength(*first);
+        unsigned char lead = static_cast<unsigned char>(*first);
+        if (static_cast<size_t>(last - first) < length || (length == 1 && lead >= 0x80)) {
+            return 0;
+        }
+        static constexpr const unsigned char leadMasks[] = {0, 0x7F, 0x1F, 0x0F, 0x07};
+        codePoint = lead & leadMasks[length];
+        for (size_t i = 1; i < length; i++) {
+            unsigned char byte = static_cast<unsigned char>(first[i]);
+            if ((byte & 0xC0) != 0x80) {
+                return 0;
+            }
+            codePoint = (codePoint << 6) | (byte & 0x3F);
+        }
+        return length;
+    }
+
+    size_t Font::utf8SequenceLength(char lead)
+    {
+        unsigned char byte = static_cast<unsigned char>(lead);
+        if (byte < 0x80) {
+            return 1;
+        } else if ((byte >> 5) == 0x06) {
+            return 2;
+        } else if ((byte >> 4) == 0x0E) {
+            return 3;
+        } else if ((byte >> 3) == 0x1E) {
+            return 4;
+        }
+        return 1;
+    }
+
     unsigned int Font::getEndValue() const
     {
         return endValue;
@@ -163,6 +610,88 @@ namespace sable {
         return m_FontWidthLocation;
     }
 
+    const std::string& Font::getName() const
+    {
+        return m_Name;
+    }
+
+    const std::string& Font::getDictionaryLocation() const
+    {
+        return m_DictionaryLocation;
+    }
+
+    int Font::getDictionaryEntryLength() const
+    {
+        return m_DictionaryEntryLength;
+    }
+
+    std::vector<unsigned int> Font::getDictionaryCodes() const
+    {
+        // Codes in the dictionary range that nothing else in the font claims.
+        std::vector<bool> taken(m_DictionaryLast - m_DictionaryFirst + 1, false);
+        auto take = [&](long long code) {
+            if (code >= m_DictionaryFirst && code <= m_DictionaryLast) {
+                taken[code - m_DictionaryFirst] = true;
+            }
+        };
+        for (auto& text: m_TextConvertMap) {
+            take(text.second.code);
+        }
+        // Behind a CommandValue prefix commands have codes of their own, and
+        // only the prefix itself is unavailable.
+        if (m_CommandValue == -1) {
+            for (auto& command: m_CommandConvertMap) {
+                take(command.second.code);
+            }
+        } else {
+            take(m_CommandValue);
+        }
+        for (auto& extra: m_Extras) {
+            take(extra.second);
+        }
+        std::vector<unsigned int> codes;
+        for (size_t i = 0; i < taken.size(); i++) {
+            if (!taken[i]) {
+                codes.push_back(m_DictionaryFirst + i);
+            }
+        }
+        return codes;
+    }
+
+    const std::vector<Font::DictionaryEntry> &Font::getDictionary() const
+    {
+        return m_Dictionary;
+    }
+
+    void Font::setDictionary(std::vector<DictionaryEntry> dictionary)
+    {
+        m_Dictionary = std::move(dictionary);
+        buildTrie();
+        buildGlyphTables();
+    }
+
+    std::string Font::getDictionaryTable() const
+    {
+        // One slot per code from the first dictionary code: the glyph count,
+        // then the glyphs padded with zeroes to the entry length.
+        size_t slotSize = 1 + m_DictionaryEntryLength * m_ByteWidth;
+        std::string table;
+        for (auto& entry: m_Dictionary) {
+            size_t offset = (entry.code - m_DictionaryFirst) * slotSize;
+            if (table.size() < offset + slotSize) {
+                table.resize(offset + slotSize, '\0');
+            }
+            table[offset++] = static_cast<char>(entry.glyphs.size());
+            for (unsigned int glyph: entry.glyphs) {
+                for (int byte = 0; byte < m_ByteWidth; byte++) {
+                    table[offset++] = static_cast<char>(glyph & 0xFF);
+                    glyph >>= 8;
+                }
+            }
+        }
+        return table;
+    }
+
     Font::operator bool() const
     {
         return m_IsValid;
@@ -259,9 +788,9 @@ namespace sable {
     }
 
     template<class T>
-    std::unordered_map<std::string, T> Font::generateMap(const YAML::Node &&node, const std::string& field, const std::function<void (std::string&)>&& formatter)
+    Font::NameMap<T> Font::generateMap(const YAML::Node &&node, const std::string& field, const std::function<void (std::string&)>&& formatter)
     {
-        std::unordered_map<std::string, T> map;
+        NameMap<T> map;
         try {
             if(!node.IsMap()) {
                 throw FontError(node.Mark(), m_Name, field, "a map.");
@@ -2,7 +2,11 @@
 #define TEXTTYPE_H
 
 #include <yaml-cpp/yaml.h>
-#include <unordered_map>
+#include <map>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <tuple>
 #include <string>
 #include <stdexcept>
 #include <functional>
@@ -24,9 +28,25 @@ namespace sable {
         static constexpr const char* ENCODING = "Encoding";
         static constexpr const char* COMMANDS = "Commands";
         static constexpr const char* EXTRAS = "Extras";
+        static constexpr const char* DICTIONARY = "Dictionary";
         static constexpr const char* CODE_VAL = "code";
         static constexpr const char* TEXT_LENGTH_VAL = "length";
         static constexpr const char* CMD_NEWLINE_VAL = "newline";
+        static constexpr const char* DICT_ADDR_VAL = "address";
+        static constexpr const char* DICT_CODES_VAL = "codes";
+        static constexpr const char* DICT_LENGTH_VAL = "length";
+        struct Symbol {
+            ReadType type = ERROR;
+            unsigned int code = 0;
+            int width = 0;
+            bool isNewLine = false;
+        };
+        struct DictionaryEntry {
+            unsigned int code;
+            std::string text;
+            std::vector<unsigned int> glyphs;
+            int width;
+        };
         Font()=default;
         Font(const YAML::Node &config, const std::string& name);
         Font& operator=(Font&&) =default;
@@ -37,13 +57,25 @@ namespace sable {
         int getMaxEncodedValue() const;
         bool getHasDigraphs() const;
         const std::string& getFontWidthLocation() const;
+        const std::string& getName() const;
+        const std::string& getDictionaryLocation() const;
+        int getDictionaryEntryLength() const;
+        std::vector<unsigned int> getDictionaryCodes() const;
+        const std::vector<DictionaryEntry>& getDictionary() const;
+        void setDictionary(std::vector<DictionaryEntry> dictionary);
+        std::string getDictionaryTable() const;
 
-        unsigned int getCommandCode(const std::string& id) const;
-        std::tuple<unsigned int, bool> getTextCode(const std::string& id, const std::string& next = "") const;
-        int getExtraValue(const std::string& id) const;
-        int getWidth(const std::string& id) const;
-        bool isCommandNewline(const std::string& id) const;
+        unsigned int getCommandCode(std::string_view id) const;
+        std::tuple<unsigned int, bool> getTextCode(std::string_view id, std::string_view next = "") const;
+        std::tuple<unsigned int, int, size_t> matchText(const char* first, const char* last) const;
+        size_t encodeRun(const char* first, const char* last, int& width, std::back_insert_iterator<std::vector<unsigned char>> inserter) const;
+        int getExtraValue(std::string_view id) const;
+        const Symbol* findSymbol(std::string_view id) const;
+        int getWidth(std::string_view id) const;
+        bool isCommandNewline(std::string_view id) const;
         void getFontWidths(std::back_insert_iterator<std::vector<int>> inserter) const;
+        void writeImage(std::string& out) const;
+        bool readImage(std::string_view& in);
 
         explicit operator bool() const;
 
@@ -51,26 +83,66 @@ namespace sable {
         struct TextNode {
             unsigned int code;
             int width = 0;
+            // Written as [Name] in the encoding, so only a bracket can use it.
+            bool isBracketed = false;
         };
         struct CommandNode {
             unsigned int code;
             bool isNewLine = false;
         };
+        struct TrieNode {
+            unsigned int code = 0;
+            int width = 0;
+            bool isTerminal = false;
+            unsigned int firstEdge = 0;
+            unsigned int edgeCount = 0;
+        };
+        struct TrieEdge {
+            unsigned char byte;
+            unsigned int target;
+        };
+        struct Glyph {
+            unsigned int code = 0;
+            int width = 0;
+            bool isSimple = false;
+        };
+        static constexpr const int GLYPH_PAGE_SIZE = 256;
         YAML::Mark m_YamlNodeMark;
         std::string m_Name;
         bool m_IsValid, m_HasDigraphs, m_IsFixedWidth;
         int m_ByteWidth, m_CommandValue, m_MaxWidth, m_MaxEncodedValue, m_DefaultWidth;
         unsigned int endValue;
         std::string m_FontWidthLocation;
-        std::unordered_map<std::string, TextNode> m_TextConvertMap;
-        std::unordered_map<std::string, CommandNode> m_CommandConvertMap;
-        std::unordered_map<std::string, int> m_Extras;
+        std::string m_DictionaryLocation;
+        int m_DictionaryFirst = 0, m_DictionaryLast = -1, m_DictionaryEntryLength = 0;
+        std::vector<DictionaryEntry> m_Dictionary;
+        template <class T>
+        using NameMap = std::map<std::string, T, std::less<>>;
+        NameMap<TextNode> m_TextConvertMap;
+        NameMap<CommandNode> m_CommandConvertMap;
+        NameMap<int> m_Extras;
+        NameMap<Symbol> m_Symbols;
+        std::vector<TrieNode> m_Trie;
+        std::vector<TrieEdge> m_TrieEdges;
+        std::array<int, 256> m_TrieRoot;
+        std::array<Glyph, 128> m_AsciiGlyphs;
+        std::array<unsigned short, 256> m_GlyphPageIndex;
+        std::vector<Glyph> m_GlyphPages;
+        bool matchesSequences() const;
+        bool isPlainText(const std::string& name, const TextNode& text) const;
+        void buildTrie();
+        void buildGlyphTables();
+        void buildSymbolTable();
+        int findTrieChild(int node, char byte) const;
+        const Glyph* findGlyph(char32_t codePoint) const;
+        static size_t utf8SequenceLength(char lead);
+        static size_t decodeUtf8(const char* first, const char* last, char32_t& codePoint);
         template <class T>
         T validate(const YAML::Node&& node, const std::string& field, const std::function<T (const T&)>& validator);
         template <class T>
         T validate(const YAML::Node&& node, const std::string& field, const std::function<T (const T&)>&& validator = [](const T& val){return val;});
         template <class T>
-        std::unordered_map<std::string, T> generateMap(const YAML::Node&& node, const std::string& field, const std::function<void (std::string&)>&& formatter = [](std::string& str){});
+        NameMap<T> generateMap(const YAML::Node&& node, const std::string& field, const std::function<void (std::string&)>&& formatter = [](std::string& str){});
     public:
         friend YAML::convert<sable::Font::TextNode>;
         friend YAML::convert<sable::Font::CommandNode>;
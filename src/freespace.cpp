@@ -0,0 +1,119 @@
+#include "freespace.h"
+#include "util.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace sable {
+
+void FreeSpace::addRegion(int start, int end)
+{
+    int pcStart = util::LoROMToPC(start);
+    int pcEnd = util::LoROMToPC(end);
+    if (pcStart == -1 || pcEnd == -1 || pcEnd < pcStart) {
+        std::ostringstream error;
+        error << std::hex << '$' << start << "-$" << end << " is not a valid free space region.";
+        throw std::runtime_error(error.str());
+    }
+    for (const Range& range: m_Free) {
+        if (pcStart < range.end && range.start <= pcEnd) {
+            std::ostringstream error;
+            error << std::hex << "Free space region $" << start << "-$" << end << " overlaps another region.";
+            throw std::runtime_error(error.str());
+        }
+    }
+    Range range = {pcStart, pcEnd + 1, (start & 0x800000) != 0};
+    m_Free.insert(std::upper_bound(m_Free.begin(), m_Free.end(), range, [](const Range& a, const Range& b) {
+        return a.start < b.start;
+    }), range);
+    m_Regions.push_back({start, end, 0});
+}
+
+void FreeSpace::reserve(int address, size_t length)
+{
+    int pc = util::LoROMToPC(address);
+    if (pc != -1 && length > 0) {
+        markUsed(pc, pc + length);
+    }
+}
+
+int FreeSpace::allocate(size_t length, bool noBankCross, int bank)
+{
+    // Best fit: the smallest free range that can hold the data, so large
+    // ranges stay available for large messages.
+    int size = length;
+    size_t best = m_Free.size();
+    int bestStart = 0;
+    for (size_t i = 0; i < m_Free.size(); i++) {
+        int start = m_Free[i].start, end = m_Free[i].end;
+        if (bank != ANY_BANK) {
+            start = std::max(start, bank * BANK_SIZE);
+            end = std::min(end, (bank + 1) * BANK_SIZE);
+        }
+        if (noBankCross && size > 0 && start / BANK_SIZE != (start + size - 1) / BANK_SIZE) {
+            start = (start / BANK_SIZE + 1) * BANK_SIZE;
+        }
+        if (start + size > end) {
+            continue;
+        }
+        if (best == m_Free.size() || m_Free[i].end - m_Free[i].start < m_Free[best].end - m_Free[best].start) {
+            best = i;
+            bestStart = start;
+        }
+    }
+    if (best == m_Free.size()) {
+        return -1;
+    }
+    bool high = m_Free[best].high;
+    markUsed(bestStart, bestStart + size);
+    return util::PCToLoROM(bestStart, false, high);
+}
+
+void FreeSpace::reset()
+{
+    std::vector<Region> regions;
+    regions.swap(m_Regions);
+    m_Free.clear();
+    for (const Region& region: regions) {
+        addRegion(region.start, region.end);
+    }
+}
+
+const std::vector<FreeSpace::Region> &FreeSpace::getRegions() const
+{
+    return m_Regions;
+}
+
+bool FreeSpace::empty() const
+{
+    return m_Regions.empty();
+}
+
+void FreeSpace::markUsed(int start, int end)
+{
+    std::vector<Range> remaining;
+    remaining.reserve(m_Free.size() + 1);
+    for (const Range& range: m_Free) {
+        if (end <= range.start || range.end <= start) {
+            remaining.push_back(range);
+            continue;
+        }
+        int overlapStart = std::max(start, range.start);
+        int overlapEnd = std::min(end, range.end);
+        for (Region& region: m_Regions) {
+            int regionStart = util::LoROMToPC(region.start);
+            if (regionStart <= overlapStart && overlapStart <= util::LoROMToPC(region.end)) {
+                region.used += overlapEnd - overlapStart;
+                break;
+            }
+        }
+        if (range.start < overlapStart) {
+            remaining.push_back({range.start, overlapStart, range.high});
+        }
+        if (overlapEnd < range.end) {
+            remaining.push_back({overlapEnd, range.end, range.high});
+        }
+    }
+    m_Free.swap(remaining);
+}
+}
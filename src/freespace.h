@@ -0,0 +1,38 @@
+#ifndef FREESPACE_H
+#define FREESPACE_H
+
+#include <string>
+#include <vector>
+
+namespace sable {
+// Tracks the declared free LoROM regions and hands out space for messages.
+// Space is kept as PC offsets, so each 32 KiB bank is contiguous with the next.
+class FreeSpace
+{
+public:
+    struct Region {
+        int start, end;
+        size_t used;
+    };
+    static constexpr const int BANK_SIZE = 0x8000;
+    static constexpr const int ANY_BANK = -1;
+
+    void addRegion(int start, int end);
+    void reserve(int address, size_t length);
+    int allocate(size_t length, bool noBankCross, int bank = ANY_BANK);
+    void reset();
+    const std::vector<Region>& getRegions() const;
+    bool empty() const;
+
+private:
+    struct Range {
+        int start, end;
+        bool high;
+    };
+    std::vector<Region> m_Regions;
+    std::vector<Range> m_Free;
+    void markUsed(int start, int end);
+};
+}
+
+#endif // FREESPACE_H
@@ -1,8 +1,45 @@
 #include <iostream>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <cxxopts.hpp>
 #include "cache.h"
 #include "project.h"
 #include "exceptions.h"
+#include "filewatcher.h"
+#include "server.h"
+#include "trace.h"
+#include "stats.h"
+
+namespace {
+// Runs one step of a build and reports the error that stopped it, if any.
+bool runStep(const std::function<void()>& step)
+{
+    using std::cerr;
+    try {
+        step();
+        return true;
+    } catch (sable::FontError &e){
+        cerr << "Error in input mapping file:\n"
+             << e.what() << std::endl;
+    } catch (sable::ParseError &e) {
+        cerr << "Fatal error during parsing:\n"
+                  << e.what() << std::endl;
+    } catch(sable::ASMError &e) {
+        cerr << std::string("Output error:\n" )
+                + e.what() << std::endl;
+    } catch (sable::ConfigError &e) {
+        cerr << "Error(s) in project config: \n"
+             << e.what() << std::endl;
+    } catch (std::exception &e) {
+        // Missing files, bad YAML and the like, which watch mode should
+        // report and keep watching through.
+        cerr << "Error:\n"
+             << e.what() << std::endl;
+    }
+    return false;
+}
+}
 
 int main(int argc, char * argv[])
 {
@@ -14,14 +51,32 @@ int main(int argc, char * argv[])
             ("s,no-assembly", "Run without running Asar assembly.")
             ("a,no-script", "Run without updating the script.")
             ("p,project", "Project directory - defaults to working directory.", cxxopts::value<std::string>(), "DIR")
+            ("f,font-image", "Compile the input mapping into cache/fonts.bin and exit.")
+            ("m,in-memory", "Keep generated files in memory and assemble from there instead of writing them to the output directory.")
+            ("k,packed", "Write the encoded text of each table directory to one file instead of one file per message.")
+            ("d,merge", "Store identical messages, and messages that end another message, only once.")
+            ("l,link", "Write text, pointer tables and font widths into the ROM directly and only assemble the includes with Asar.")
+            ("full-assembly", "Assemble each ROM's patch in full instead of assembling the part the ROMs share once.")
+            ("patch", "Also write an IPS or BPS patch against the base ROM next to each patched ROM, or both with ips,bps.", cxxopts::value<std::vector<std::string>>(), "FORMATS")
+            ("w,watch", "Keep running and rebuild whenever scripts, tables, the input mapping, assembly includes or ROMs change.")
+            ("socket", "Unix domain socket the build server listens on.", cxxopts::value<std::string>(), "PATH")
+            ("idle-timeout", "Seconds without requests after which the build server exits - defaults to 600, 0 waits forever.", cxxopts::value<int>(), "SECONDS")
+            ("command", "Run \"serve\" to start a build server instead of building once.", cxxopts::value<std::string>())
+            ("trace", "Record how long each step takes as Chrome trace-event JSON, which chrome://tracing and Perfetto can open.", cxxopts::value<std::string>(), "FILE")
+            ("stats", "Print counts of the work done after each build, as a table or with --stats=json as JSON.", cxxopts::value<std::string>()->implicit_value("table"), "FORMAT")
+            ("j,jobs", "Number of threads used to parse scripts and processes used to patch ROMs - defaults to one per core.", cxxopts::value<unsigned int>(), "N")
             ("v,verbose", "Run with increased verbosity.")
             ("q,quiet", "Run with reduced verbosity.")
             ("h,help", "Show this message.");
+    programOptions.parse_positional({"command"});
     auto options = programOptions.parse(argc, argv);
     bool showHelp = options.count("h") > 0;
     if (options.count("s") > 0 && options.count("a") > 0) {
         cout << "Nothing to do, printing help.\n";
         showHelp = true;
+    } else if (options.count("l") > 0 && (options.count("s") > 0 || options.count("a") > 0)) {
+        cout << "Linking needs the script to be parsed and assembled in the same run, printing help.\n";
+        showHelp = true;
     }
     int verbosity = 1;
     if(options.count("v") > 0) {
@@ -33,44 +88,173 @@ int main(int argc, char * argv[])
     fs::path starting_path = isCurrentDirNotProject ? options["project"].as<std::string>() : fs::current_path().string();
     if (showHelp) {
          cout << programOptions.help({"", "Group"}) << '\n';
-    } else {
+         return 0;
+    }
+    unsigned int patchFormats = 0;
+    if (options.count("patch") > 0) {
+        for (const std::string& format: options["patch"].as<std::vector<std::string>>()) {
+            if (format == "ips") {
+                patchFormats |= sable::Project::IPS_PATCH;
+            } else if (format == "bps") {
+                patchFormats |= sable::Project::BPS_PATCH;
+            } else {
+                cerr << "Unknown patch format " << format << ", use ips or bps.\n";
+                return 1;
+            }
+        }
+    }
+    auto writeTrace = [&]() {
+        if (options.count("trace") > 0 && !sable::trace::write(options["trace"].as<std::string>())) {
+            cerr << "Could not write " << options["trace"].as<std::string>() << ".\n";
+        }
+    };
+    if (options.count("trace") > 0) {
+        sable::trace::start();
+    }
+    if (options.count("stats") > 0) {
+        if (options["stats"].as<std::string>() != "table" && options["stats"].as<std::string>() != "json") {
+            cerr << "Unknown statistics format " << options["stats"].as<std::string>() << ", use table or json.\n";
+            return 1;
+        }
+        sable::stats::start();
+    }
+    auto printStats = [&]() {
+        if (options.count("stats") > 0) {
+            sable::stats::Totals totals = sable::stats::collect();
+            if (options["stats"].as<std::string>() == "json") {
+                cout << sable::stats::formatJson(totals) << '\n';
+            } else {
+                cout << sable::stats::formatTable(totals);
+            }
+            cout << std::flush;
+        }
+    };
+    if (options.count("command") > 0) {
+        if (options["command"].as<std::string>() != "serve") {
+            cerr << "Unknown command " << options["command"].as<std::string>() << ".\n";
+            return 1;
+        }
+        std::string socketPath = options.count("socket") > 0 ? options["socket"].as<std::string>() : sable::BuildServer::defaultSocketPath();
         try {
-            sable::Cache cache(starting_path.string());
-            unsigned int maxAddress = cache.getMaxAddress();
-            sable::Project parser(starting_path.string());
-            if (parser) {
-                if (!options.count("a")) {
-                    parser.parseText();
-                    if (parser.getWarningCount() > 0) {
-                        cerr << "Issues found during parsing:\n";
-                        for(int i = 0; i < parser.getWarningCount(); i++){
-                            cerr << parser.getWarnings()[i] << '\n';
-                        }
-                        cerr << std::flush;
+            sable::BuildServer server(socketPath, options.count("idle-timeout") > 0 ? options["idle-timeout"].as<int>() : 600);
+            if (verbosity > 0) {
+                cout << "Listening on " << socketPath << '\n' << std::flush;
+            }
+            server.run();
+        } catch (std::runtime_error &e) {
+            cerr << e.what() << std::endl;
+            writeTrace();
+            return 1;
+        }
+        writeTrace();
+        return 0;
+    }
+    sable::Cache cache(starting_path.string());
+    std::unique_ptr<sable::Project> parser;
+    auto load = [&]() {
+        parser = std::make_unique<sable::Project>(starting_path.string());
+        if (options.count("jobs") > 0) {
+            parser->setThreadCount(options["jobs"].as<unsigned int>());
+        }
+        parser->setWriteOutput(options.count("m") == 0);
+        parser->setPackedOutput(options.count("k") > 0);
+        parser->setLinkOutput(options.count("l") > 0);
+        parser->setMergeMessages(options.count("d") > 0);
+        parser->setSharedAssembly(options.count("full-assembly") == 0);
+        parser->setPatchFormats(patchFormats);
+    };
+    auto parse = [&]() {
+        parser->parseText(&cache);
+        if (parser->getWarningCount() > 0) {
+            cerr << "Issues found during parsing:\n";
+            for(int i = 0; i < parser->getWarningCount(); i++){
+                cerr << parser->getWarnings()[i] << '\n';
+            }
+            cerr << std::flush;
+        }
+        if (verbosity > 0) {
+            if (parser->getMergedSize() > 0) {
+                cout << "Merged messages saved " << parser->getMergedSize() << " bytes.\n";
+            }
+            for (auto& region: parser->getFreeSpace()) {
+                size_t size = sable::util::LoROMToPC(region.end) - sable::util::LoROMToPC(region.start) + 1;
+                cout << "Free space $" << std::hex << region.start << "-$" << region.end << std::dec
+                     << ": " << region.used << " of " << size << " bytes used ("
+                     << region.used * 100 / size << "%).\n";
+            }
+        }
+        cache.setMaxAddress(parser->getMaxAddress());
+        cache.write();
+    };
+    auto patch = [&]() {
+        parser->writePatchData();
+    };
+    if (options.count("w") > 0) {
+        // The project, its fonts, the encoded files in the cache and the base
+        // ROMs stay in memory, so each change only redoes the steps it affects.
+        sable::FileWatcher watcher;
+        watcher.addDirectory(starting_path.string(), false);
+        sable::Project::Change change = sable::Project::CONFIG_CHANGE;
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            bool success = true;
+            if (change == sable::Project::CONFIG_CHANGE) {
+                success = runStep([&]() {
+                    parser.reset();
+                    load();
+                    if (!options.count("s")) {
+                        parser->loadRoms();
+                    }
+                    for (auto& dir: parser->getWatchDirectories()) {
+                        watcher.addDirectory(dir.first, dir.second);
                     }
-                    cache.setMaxAddress(parser.getMaxAddress());
-                    cache.write();
+                });
+            } else if (change == sable::Project::ROM_CHANGE && !options.count("s")) {
+                success = runStep([&]() {
+                    parser->loadRoms();
+                });
+            }
+            if (success && change >= sable::Project::SCRIPT_CHANGE && !options.count("a")) {
+                success = runStep(parse);
+            }
+            if (success && !options.count("s")) {
+                success = runStep(patch);
+            }
+            writeTrace();
+            printStats();
+            if (verbosity > 0) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                cout << (success ? "Build finished in " : "Build failed after ") << elapsed.count() << " ms, watching for changes.\n" << std::flush;
+            }
+            do {
+                change = parser ? sable::Project::NO_CHANGE : sable::Project::CONFIG_CHANGE;
+                for (auto& file: watcher.wait()) {
+                    change = parser ? std::max(change, parser->classifyChange(file)) : sable::Project::CONFIG_CHANGE;
                 }
-                if (!options.count("s")) {
-                    parser.writePatchData();
+            } while (change == sable::Project::NO_CHANGE);
+        }
+    }
+    runStep([&]() {
+        load();
+        if (*parser) {
+            if (options.count("f")) {
+                if (parser->writeFontImage()) {
+                    cout << "Font image written to cache/fonts.bin.\n";
+                } else {
+                    cerr << "Could not write cache/fonts.bin.\n";
                 }
+            } else if (!options.count("a")) {
+                parse();
+            }
+            if (!options.count("s") && !options.count("f")) {
+                patch();
             }
-        } catch (sable::FontError &e){
-            cerr << "Error in input mapping file:\n"
-                 << e.what() << std::endl;
-        } catch (sable::ParseError &e) {
-            cerr << "Fatal error during parsing:\n"
-                      << e.what() << std::endl;
-        } catch(sable::ASMError &e) {
-            cerr << std::string("Output error:\n" )
-                    + e.what() << std::endl;
-        } catch (sable::ConfigError &e) {
-            cerr << "Error(s) in project config: \n"
-                 << e.what() << std::endl;
         }
-        cout << "Press enter to continue." << std::flush;
-        std::cin.get();
-        cout << std::endl;
-    }
+    });
+    writeTrace();
+    printStats();
+    cout << "Press enter to continue." << std::flush;
+    std::cin.get();
+    cout << std::endl;
     return 0;
 }
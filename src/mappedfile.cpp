@@ -0,0 +1,102 @@
+#include "mappedfile.h"
+#include <fstream>
+#include "stats.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+sable::MappedFile::MappedFile(const std::string &path) : m_Mapping(nullptr), m_Size(0), m_IsOpen(false)
+{
+#ifdef _WIN32
+    m_MappingHandle = nullptr;
+    m_FileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_FileHandle != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(m_FileHandle, &size) && size.QuadPart > 0) {
+            m_MappingHandle = CreateFileMappingA(m_FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (m_MappingHandle != nullptr) {
+                m_Mapping = MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0);
+                if (m_Mapping != nullptr) {
+                    m_Size = size.QuadPart;
+                }
+            }
+        }
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd != -1) {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                m_Mapping = mapping;
+                m_Size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if (m_Mapping != nullptr) {
+        m_IsOpen = true;
+    } else {
+        // Fall back to reading the whole file in one go.
+        std::ifstream input(path, std::ios::in | std::ios::binary | std::ios::ate);
+        if (input) {
+            m_Buffer.resize(input.tellg());
+            input.seekg(0, std::ios::beg);
+            input.read(&m_Buffer[0], m_Buffer.size());
+            m_Size = m_Buffer.size();
+            m_IsOpen = true;
+        }
+    }
+    if (m_IsOpen && stats::enabled()) {
+        stats::add(stats::FILES_OPENED);
+    }
+}
+
+sable::MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (m_Mapping != nullptr) {
+        UnmapViewOfFile(m_Mapping);
+    }
+    if (m_MappingHandle != nullptr) {
+        CloseHandle(m_MappingHandle);
+    }
+    if (m_FileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_FileHandle);
+    }
+#else
+    if (m_Mapping != nullptr) {
+        munmap(m_Mapping, m_Size);
+    }
+#endif
+}
+
+std::string_view sable::MappedFile::data() const
+{
+    if (m_Mapping != nullptr) {
+        return std::string_view(static_cast<const char*>(m_Mapping), m_Size);
+    }
+    return m_Buffer;
+}
+
+size_t sable::MappedFile::size() const
+{
+    return m_Size;
+}
+
+bool sable::MappedFile::isMapped() const
+{
+    return m_Mapping != nullptr;
+}
+
+sable::MappedFile::operator bool() const
+{
+    return m_IsOpen;
+}
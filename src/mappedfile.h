@@ -0,0 +1,32 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+
+namespace sable {
+class MappedFile
+{
+public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    std::string_view data() const;
+    size_t size() const;
+    bool isMapped() const;
+    explicit operator bool() const;
+
+private:
+    void* m_Mapping;
+    size_t m_Size;
+    bool m_IsOpen;
+#ifdef _WIN32
+    void* m_FileHandle;
+    void* m_MappingHandle;
+#endif
+    std::string m_Buffer;
+};
+}
+
+#endif // MAPPEDFILE_H
@@ -1,125 +1,265 @@
 #include "parse.h"
 #include "util.h"
+#include "trace.h"
+#include "stats.h"
 #include <sstream>
-#include <utf8.h>
 #include <iostream>
 #include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+namespace {
+size_t countCodePoints(const char* first, size_t length)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++) {
+        count += (static_cast<unsigned char>(first[i]) & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+// Counted per line and added to the build statistics once.
+struct LineCounts {
+    uint64_t characters = 0, digraphs = 0, commands = 0, extras = 0, directives = 0;
+
+    void add(std::string_view font) const
+    {
+        namespace stats = sable::stats;
+        if (characters > 0) {
+            stats::add(stats::CHARACTERS, font, characters);
+        }
+        if (digraphs > 0) {
+            stats::add(stats::DIGRAPHS, font, digraphs);
+        }
+        if (commands > 0) {
+            stats::add(stats::COMMANDS, commands);
+        }
+        if (extras > 0) {
+            stats::add(stats::EXTRAS, extras);
+        }
+        if (directives > 0) {
+            stats::add(stats::DIRECTIVES, directives);
+        }
+    }
+};
+}
+
 namespace sable {
 
 TextParser::TextParser(const YAML::Node& node, const std::string& defaultMode, const std::string& nlName) :
     defaultFont(defaultMode), newLineName(nlName)
     {
         for (auto it = node.begin(); it != node.end(); ++it) {
-            m_Fonts[it->first.as<std::string>()] = Font(it->second, it->first.as<std::string>());
+            std::string name = it->first.as<std::string>();
+            trace::Span span("font", name);
+            m_Fonts[name] = Font(it->second, name);
+        }
+    }
+
+TextParser::TextParser(const std::string& defaultMode, const std::string& nlName) :
+    defaultFont(defaultMode), newLineName(nlName)
+    {
+    }
+
+    std::string TextParser::getFontImage(uint64_t sourceHash) const
+    {
+        std::string image(IMAGE_MAGIC);
+        util::writeValue(image, IMAGE_VERSION);
+        util::writeValue(image, sourceHash);
+        util::writeValue<uint32_t>(image, m_Fonts.size());
+        for (auto& font: m_Fonts) {
+            font.second.writeImage(image);
         }
+        return image;
     }
 
-    std::pair<bool, int> TextParser::parseLine(std::istream &input, ParseSettings & settings, back_inserter insert)
+    bool TextParser::readFontImage(std::string_view image, uint64_t sourceHash)
+    {
+        trace::Span span("readFontImage");
+        uint32_t version, fontCount;
+        uint64_t hash;
+        if (image.compare(0, std::strlen(IMAGE_MAGIC), IMAGE_MAGIC) != 0) {
+            return false;
+        }
+        image.remove_prefix(std::strlen(IMAGE_MAGIC));
+        if (!util::readValue(image, version) || version != IMAGE_VERSION
+                || !util::readValue(image, hash) || hash != sourceHash
+                || !util::readValue(image, fontCount)) {
+            return false;
+        }
+        std::map<std::string, Font, std::less<>> fonts;
+        for (uint32_t i = 0; i < fontCount; i++) {
+            Font font;
+            if (!font.readImage(image)) {
+                return false;
+            }
+            std::string name = font.getName();
+            fonts[name] = std::move(font);
+        }
+        if (!image.empty()) {
+            return false;
+        }
+        m_Fonts = std::move(fonts);
+        return true;
+    }
+
+    std::pair<bool, int> TextParser::parseLine(std::istream &input, ParseSettings & settings, back_inserter insert) const
+    {
+        std::string line;
+        if (getline(input, line, '\n').fail()) {
+            return std::make_pair(true, 0);
+        }
+        return parseLine(line, input.peek(), settings, insert);
+    }
+
+    std::pair<bool, int> TextParser::parseLine(std::string_view line, int next, ParseSettings &settings, back_inserter insert) const
     {
-        int read_count = 0;
         int length = 0;
         bool finished = false;
-        std::string line;
-        Font& activeFont = m_Fonts.at(settings.mode);
-        std::istream& state = getline(input, line, '\n');
-        if (!state.fail()) {
-            if (line.find('\r') != std::string::npos) {
-                line.erase(line.find('\r'), 1);
-            }
-            auto it = line.begin();
-            bool printNewLine = true;
-            while (it != line.end() && !finished) {
-                std::string currentChar = readUtf8Char(it, line.end());
-                if (currentChar == "#") {
-                    finished = true;
-                    if (it - line.begin() == 1) {
-                        printNewLine = false;
-                    }
-                } else if (currentChar == "[") {
-                    std::string temp;
-                    {
-                        size_t endPt = line.find_first_of(']', it - line.begin());
-                        if (endPt == std::string::npos) {
-                            throw std::runtime_error("");
-                        }
-                        size_t distance = (line.begin() +endPt) - it;
-                        temp = std::string(it, it+distance);
-                        it += distance + 1;
+        bool printNewLine = true;
+        const Font& activeFont = m_Fonts.at(settings.mode);
+        size_t carriageReturn = line.find('\r');
+        if (carriageReturn != std::string_view::npos && carriageReturn == line.length() - 1) {
+            line.remove_suffix(1);
+        } else if (carriageReturn != std::string_view::npos) {
+            thread_local std::string strippedLine;
+            strippedLine.assign(line).erase(carriageReturn, 1);
+            line = strippedLine;
+        }
+        size_t position = 0, runEnd = 0;
+        const bool counting = stats::enabled();
+        LineCounts counts;
+        while (position < line.length() && !finished) {
+            if (line[position] == '#') {
+                finished = true;
+                if (position == 0) {
+                    printNewLine = false;
+                }
+            } else if (line[position] == '[') {
+                size_t endPt = line.find(']', position + 1);
+                if (endPt == std::string_view::npos) {
+                    throw std::runtime_error("");
+                }
+                std::string_view token = line.substr(position + 1, endPt - position - 1);
+                position = endPt + 1;
+                unsigned int code;
+                int bytes;
+                std::tie(code, bytes) = util::strToHex(token);
+                counts.commands += bytes >= 0;
+                if (bytes < 0) {
+                    bytes = activeFont.getByteWidth();
+                    const Font::Symbol* symbol = activeFont.findSymbol(token);
+                    if (symbol == nullptr) {
+                        throw std::runtime_error("[" + std::string(token) + "] is not a command, character or extra in mode " + settings.mode);
                     }
-                    {
-                        unsigned int code;
-                        int bytes;
-                        std::tie(code, bytes) = util::strToHex(temp);
-                        if (bytes < 0) {
-                            bytes = activeFont.getByteWidth();
-                            try {
-                                code = activeFont.getCommandCode(temp);
-                                finished = (settings.autoend && code == activeFont.getEndValue());
-                                if (activeFont.getCommandValue() != -1 && !finished) {
-                                    insertData(activeFont.getCommandValue(), activeFont.getByteWidth(), insert);
-                                }
-                                printNewLine = !activeFont.isCommandNewline(temp);
-                            } catch (std::runtime_error &e) {
-                                try {
-                                    std::tie(code, std::ignore) = activeFont.getTextCode(temp);
-                                    length += activeFont.getWidth(temp);
-                                } catch (std::runtime_error &e) {
-                                    code = activeFont.getExtraValue(temp);
-                                }
-                                finished = settings.autoend && (activeFont.getCommandValue() == -1) && (code == activeFont.getEndValue());
-                            }
+                    code = symbol->code;
+                    if (symbol->type == Font::COMMAND) {
+                        finished = (settings.autoend && code == activeFont.getEndValue());
+                        if (activeFont.getCommandValue() != -1 && !finished) {
+                            insertData(activeFont.getCommandValue(), activeFont.getByteWidth(), insert);
                         }
-                        if (!finished) {
-                            insertData(code, bytes, insert);
-                        }
-                    }
-                } else if (currentChar == "@") {
-                    settings = updateSettings(settings, std::string(it, line.end()), settings.currentAddress);
-                    if (it - line.begin() == 1 && (state.peek() != std::char_traits<char>::eof())) {
-                        return std::make_pair(finished, length);
+                        printNewLine = !symbol->isNewLine;
+                        counts.commands++;
+                    } else {
+                        counts.extras += symbol->type == Font::EXTRA;
+                        counts.characters += symbol->type != Font::EXTRA;
+                        length += symbol->width;
+                        finished = settings.autoend && (activeFont.getCommandValue() == -1) && (code == activeFont.getEndValue());
                     }
-                    it = line.end();
-                } else {
-                    if (settings.currentAddress == 0) {
-                        throw std::runtime_error("Attempted to parse text before address was set.");
+                }
+                if (!finished) {
+                    insertData(code, bytes, insert);
+                }
+            } else if (line[position] == '@') {
+                applySetting(settings, line.substr(position + 1));
+                counts.directives++;
+                if (position == 0 && next != std::char_traits<char>::eof()) {
+                    if (counting) {
+                        counts.add(activeFont.getName());
                     }
-                    std::string nextChar = (it == line.end() || !activeFont.getHasDigraphs()) ? "" : readUtf8Char(it, line.end(), false);
+                    return std::make_pair(finished, length);
+                }
+                position = line.length();
+            } else {
+                if (settings.currentAddress == 0) {
+                    throw std::runtime_error("Attempted to parse text before address was set.");
+                }
+                if (settings.textSink && position >= runEnd) {
+                    runEnd = std::min(line.find_first_of("#[@", position), line.length());
+                    settings.textSink(settings.mode, line.substr(position, runEnd - position));
+                }
+                const char* first = line.data() + position;
+                const char* last = line.data() + line.length();
+                int width;
+                size_t matched = activeFont.encodeRun(first, last, width, insert);
+                if (matched == 0) {
                     unsigned int code;
-                    bool advance;
-                    std::tie<>(code, advance) = activeFont.getTextCode(currentChar, nextChar);
-                    if (advance) {
-                        utf8::next(it, line.end());
-                        length += activeFont.getWidth(currentChar + nextChar);
-                    } else {
-                        length += activeFont.getWidth(currentChar);
-                    }
+                    std::tie(code, width, matched) = activeFont.matchText(first, last);
                     insertData(code, activeFont.getByteWidth(), insert);
+                    if (counting) {
+                        size_t characters = countCodePoints(first, matched);
+                        counts.characters += characters;
+                        counts.digraphs += characters > 1;
+                    }
+                } else if (counting) {
+                    counts.characters += countCodePoints(first, matched);
                 }
+                position += matched;
+                length += width;
             }
-            finished |= (state.peek() == std::char_traits<char>::eof());
-            if (printNewLine && !finished && !state.eof() && input.peek() != '#'  && input.peek() != '@') {
-                if (activeFont.getCommandValue() != -1) {
-                    insertData(activeFont.getCommandValue(), activeFont.getByteWidth(), insert);
-                }
-                insertData(activeFont.getCommandCode(newLineName), activeFont.getByteWidth(), insert);
+        }
+        finished |= (next == std::char_traits<char>::eof());
+        if (printNewLine && !finished && next != '#'  && next != '@') {
+            if (activeFont.getCommandValue() != -1) {
+                insertData(activeFont.getCommandValue(), activeFont.getByteWidth(), insert);
             }
-            if (settings.autoend && finished) {
-                if (activeFont.getCommandValue() != -1) {
-                    insertData(activeFont.getCommandValue(), activeFont.getByteWidth(), insert);
-                }
-                insertData(activeFont.getEndValue(), activeFont.getByteWidth(), insert);
+            insertData(activeFont.getCommandCode(newLineName), activeFont.getByteWidth(), insert);
+        }
+        if (settings.autoend && finished) {
+            if (activeFont.getCommandValue() != -1) {
+                insertData(activeFont.getCommandValue(), activeFont.getByteWidth(), insert);
             }
-        } else {
-            finished = true;
+            insertData(activeFont.getEndValue(), activeFont.getByteWidth(), insert);
+        }
+        if (counting) {
+            counts.add(activeFont.getName());
         }
         return std::make_pair(finished, length);
     }
 
-    const std::map<std::string, Font> &TextParser::getFonts() const
+    void TextParser::parseBuffer(std::string_view buffer, ParseSettings &settings, back_inserter insert, const line_sink& sink) const
+    {
+        int line = 0;
+        size_t start = 0;
+        while (start < buffer.length()) {
+            size_t end = std::min(buffer.find('\n', start), buffer.length());
+            size_t nextStart = std::min(end + 1, buffer.length());
+            int next = nextStart < buffer.length()
+                    ? std::char_traits<char>::to_int_type(buffer[nextStart])
+                    : std::char_traits<char>::eof();
+            bool done;
+            int length;
+            std::tie(done, length) = parseLine(buffer.substr(start, end - start), next, settings, insert);
+            sink(done, length, ++line);
+            start = nextStart;
+        }
+    }
+
+    const std::map<std::string, Font, std::less<>> &TextParser::getFonts() const
     {
         return m_Fonts;
     }
 
+    void TextParser::setDictionary(std::string_view font, std::vector<Font::DictionaryEntry> dictionary)
+    {
+        auto it = m_Fonts.find(font);
+        if (it != m_Fonts.end()) {
+            it->second.setDictionary(std::move(dictionary));
+        }
+    }
+
     void TextParser::insertData(unsigned int code, int size, back_inserter bi)
     {
         while (size-- > 0) {
@@ -128,75 +268,99 @@ TextParser::TextParser(const YAML::Node& node, const std::string& defaultMode, c
         }
     }
 
-    std::string TextParser::readUtf8Char(std::string::iterator& start, std::string::iterator end, bool advance)
+    ParseSettings TextParser::updateSettings(const ParseSettings &settings, const std::string &setting, unsigned int currentAddress) const
     {
-        std::string out("");
-        if (advance) {
-            utf8::append(utf8::next(start, end), std::back_inserter(out));
-        } else {
-            utf8::append(utf8::peek_next(start, end), std::back_inserter(out));
-        }
-        return out;
+        ParseSettings retVal = settings;
+        applySetting(retVal, setting);
+        return retVal;
     }
 
-    ParseSettings TextParser::updateSettings(const ParseSettings &settings, const std::string &setting, unsigned int currentAddress)
+    void TextParser::applySetting(ParseSettings &settings, std::string_view setting) const
     {
-        ParseSettings retVal = settings;
         if (!setting.empty()) {
-            std::string name;
-            std::istringstream str(setting);
-            str >> name;
+            std::string_view name = nextToken(setting);
             if (name == "printpc") {
-                retVal.printpc = true;
+                settings.printpc = true;
             } else {
-                std::string option;
-                str >> option;
-                if (!str.fail()) {
+                std::string_view option = nextToken(setting);
+                if (!option.empty()) {
                     if (name == "type") {
                         if (option == "default") {
-                            retVal.mode = defaultFont;
+                            settings.mode = defaultFont;
                         } else if (m_Fonts.find(option) == m_Fonts.end()) {
-                            throw std::runtime_error(option.insert(0, "Font \"") + "\" was not defined");
+                            throw std::runtime_error("Font \"" + std::string(option) + "\" was not defined");
                         } else {
-                            retVal.mode = option;
+                            settings.mode = option;
                         }
-                        if (retVal.maxWidth >= 0) {
-                            retVal.maxWidth = m_Fonts[retVal.mode].getMaxWidth();
+                        if (settings.maxWidth >= 0) {
+                            settings.maxWidth = m_Fonts.at(settings.mode).getMaxWidth();
                         }
                     } else if (name == "address") {
                         if (option != "auto") {
-                            retVal.currentAddress = util::strToHex(option).first;
+                            settings.currentAddress = util::strToHex(option).first;
                         }
                     } else if (name == "width") {
                         if (option == "off") {
-                            retVal.maxWidth = -1;
+                            settings.maxWidth = -1;
                         } else {
-                            std::istringstream(option) >> std::dec >> retVal.maxWidth;
+                            settings.maxWidth = readDecimal(option);
                         }
                     } else if (name == "label") {
-                        retVal.label = option;
+                        settings.label = option;
                     } else if (name == "autoend") {
                         if (option == "on") {
-                            retVal.autoend = true;
+                            settings.autoend = true;
                         } else if (option == "off") {
-                            retVal.autoend = false;
+                            settings.autoend = false;
                         } else {
-                            throw std::runtime_error(option.insert(0, "Invalid option \"") + "\" for autoend: must be on or off");
+                            throw std::runtime_error("Invalid option \"" + std::string(option) + "\" for autoend: must be on or off");
                         }
                     } else {
-                        throw std::runtime_error(name.insert(0, "Unrecognized option \"") + '\"');
+                        throw std::runtime_error("Unrecognized option \"" + std::string(name) + '\"');
                     }
                 } else {
-                    throw std::runtime_error(name.insert(0, "Option \"") + "\" is missing a required value");
+                    throw std::runtime_error("Option \"" + std::string(name) + "\" is missing a required value");
                 }
             }
         }
-        return retVal;
     }
 
-    ParseSettings TextParser::getDefaultSetting(int address)
+    std::string_view TextParser::nextToken(std::string_view &text)
+    {
+        size_t start = 0;
+        while (start < text.length() && std::isspace(static_cast<unsigned char>(text[start]))) {
+            start++;
+        }
+        size_t end = start;
+        while (end < text.length() && !std::isspace(static_cast<unsigned char>(text[end]))) {
+            end++;
+        }
+        std::string_view token = text.substr(start, end - start);
+        text.remove_prefix(end);
+        return token;
+    }
+
+    int TextParser::readDecimal(std::string_view text)
+    {
+        if (!text.empty() && text.front() == '+') {
+            text.remove_prefix(1);
+            if (!text.empty() && text.front() == '-') {
+                return 0;
+            }
+        }
+        int value = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.length(), value);
+        if (result.ec == std::errc::result_out_of_range) {
+            return text.front() == '-' ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max();
+        } else if (result.ec != std::errc()) {
+            return 0;
+        }
+        return value;
+    }
+
+    ParseSettings TextParser::getDefaultSetting(int address) const
     {
-        return {true, false, defaultFont, "", m_Fonts[defaultFont].getMaxWidth(), address};
+        return {true, false, defaultFont, "", m_Fonts.at(defaultFont).getMaxWidth(), address, {}};
     }
 
 }
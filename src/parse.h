@@ -2,19 +2,38 @@
 #define PARSE_H
 
 #include <istream>
+#include <exception>
 #include <map>
 #include <string>
+#include <string_view>
 #include <yaml-cpp/yaml.h>
 #include "font.h"
 #include <tuple>
+#include <functional>
 
 namespace sable {
     typedef std::back_insert_iterator<std::vector<unsigned char>> back_inserter;
+    typedef std::function<void (bool done, int length, int line)> line_sink;
+    typedef std::function<void (const std::string& mode, std::string_view text)> text_sink;
     struct ParseSettings {
         bool autoend, printpc;
         std::string mode, label;
         int maxWidth;
         int currentAddress;
+        // Receives each run of plain text between commands, comments and settings.
+        text_sink textSink;
+    };
+    struct EncodedMessage {
+        std::string label;
+        int address;
+        bool printpc;
+        std::vector<unsigned char> data;
+    };
+    struct EncodedFile {
+        std::vector<EncodedMessage> messages;
+        std::vector<std::string> warnings;
+        int endAddress;
+        std::exception_ptr error;
     };
 
     class TextParser
@@ -22,23 +41,33 @@ namespace sable {
     public:
         TextParser()=default;
         TextParser(const YAML::Node& node, const std::string& defaultMode, const std::string& newlineName = "NewLine");
+        TextParser(const std::string& defaultMode, const std::string& newlineName = "NewLine");
+        static constexpr const char* IMAGE_MAGIC = "SBLF";
+        static constexpr const uint32_t IMAGE_VERSION = 3;
         struct lineNode{
             bool hasNewLines;
             int length;
             std::vector<unsigned char> data;
         };
 
-        std::pair<bool, int> parseLine(std::istream &input, ParseSettings &settings, back_inserter insert);
-        const std::map<std::string, Font>& getFonts() const;
+        std::pair<bool, int> parseLine(std::istream &input, ParseSettings &settings, back_inserter insert) const;
+        std::pair<bool, int> parseLine(std::string_view line, int next, ParseSettings &settings, back_inserter insert) const;
+        void parseBuffer(std::string_view buffer, ParseSettings &settings, back_inserter insert, const line_sink& sink) const;
+        const std::map<std::string, Font, std::less<>>& getFonts() const;
+        void setDictionary(std::string_view font, std::vector<Font::DictionaryEntry> dictionary);
+        std::string getFontImage(uint64_t sourceHash) const;
+        bool readFontImage(std::string_view image, uint64_t sourceHash);
         static void insertData(unsigned int code, int size, back_inserter bi);
-        ParseSettings updateSettings(const ParseSettings &settings, const std::string& setting = "", unsigned int currentAddress = 0);
-        ParseSettings getDefaultSetting(int address);
+        ParseSettings updateSettings(const ParseSettings &settings, const std::string& setting = "", unsigned int currentAddress = 0) const;
+        void applySetting(ParseSettings &settings, std::string_view setting) const;
+        ParseSettings getDefaultSetting(int address) const;
     private:
         bool useDigraphs;
         int maxWidth;
-        std::map<std::string, Font> m_Fonts;
+        std::map<std::string, Font, std::less<>> m_Fonts;
         std::string defaultFont, newLineName;
-        static std::string readUtf8Char(std::string::iterator& start, std::string::iterator end, bool advance = true);
+        static std::string_view nextToken(std::string_view& text);
+        static int readDecimal(std::string_view text);
     };
 }
 
@@ -4,10 +4,49 @@
 #include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <memory>
+#include <array>
+#include <charconv>
+#include <numeric>
+#include <unordered_set>
 #include "wrapper/filesystem.h"
 #include "util.h"
 #include "rompatcher.h"
 #include "exceptions.h"
+#include "mappedfile.h"
+#include "workerpool.h"
+#include "dictionary.h"
+#include "trace.h"
+#include "stats.h"
+#include "asmscan.h"
+
+namespace {
+// Leading byte of a patch result sent back by a worker, followed by the
+// messages for that ROM, each terminated by a null character. When tracing,
+// the worker's spans follow after PATCH_TRACE.
+constexpr char PATCH_SUCCESS = 'S';
+constexpr char PATCH_ASM_ERROR = 'A';
+constexpr char PATCH_EXCEPTION = 'E';
+constexpr char PATCH_TRACE = '\x1e';
+// Where the shared part of the patches starts when it is assembled on its own.
+// Asar cannot write there, and labels there can only have been defined before
+// the first org.
+constexpr int SHARED_PATCH_ORIGIN = 0x7FFF00;
+
+void appendHex(std::string& out, unsigned int value, int minDigits = 0)
+{
+    char digits[8];
+    char* end = std::to_chars(digits, digits + sizeof (digits), value, 16).ptr;
+    for (int padding = minDigits - (end - digits); padding > 0; padding--) {
+        out += '0';
+    }
+    out.append(digits, end);
+}
+}
 
 namespace sable {
 
@@ -55,6 +94,20 @@ void Project::init(const YAML::Node &config, const std::string &projectDir)
             m_Includes = outputConfig[INCLUDE_VAL].as<vector<string>>();
         }
         m_Roms = config[ROMS].as<vector<Rom>>();
+        if (config[FREE_SPACE].IsDefined()) {
+            for (auto region: config[FREE_SPACE]) {
+                try {
+                    auto start = util::strToHex(region["start"].as<string>());
+                    auto end = util::strToHex(region["end"].as<string>());
+                    if (start.second < 0 || end.second < 0) {
+                        throw std::runtime_error(region["start"].as<string>() + '-' + region["end"].as<string>() + " is not a pair of SNES addresses.");
+                    }
+                    m_FreeSpace.addRegion(start.first, end.first);
+                } catch (std::runtime_error &e) {
+                    throw ConfigError(e.what());
+                }
+            }
+        }
         fs::path fontLocation = mainDir
                 / config[CONFIG_SECTION][DIR_VAL].as<string>()
                 / config[CONFIG_SECTION][IN_MAP].as<string>();
@@ -63,14 +116,44 @@ void Project::init(const YAML::Node &config, const std::string &projectDir)
         if (!fs::exists(fontLocation)) {
             throw ConfigError(fontLocation.string() + " not found.");
         }
-        m_Parser = TextParser(YAML::LoadFile(fontLocation.string()), defaultMode);
+        // The compiled font image is used until in.yml changes.
+        MappedFile fontSource(fontLocation.string());
+        m_FontHash = util::hashData(fontSource.data());
+        m_FontImageFile = (mainDir / "cache" / "fonts.bin").string();
+        m_ProjectDir = fs::absolute(mainDir).lexically_normal().string();
+        m_FontFile = fs::absolute(fontLocation).lexically_normal().string();
+        m_Parser = TextParser(defaultMode);
+        bool hasFontImage;
+        {
+            MappedFile fontImage(m_FontImageFile);
+            hasFontImage = fontImage && m_Parser.readFontImage(fontImage.data(), m_FontHash);
+        }
+        if (!hasFontImage) {
+            m_Parser = TextParser(YAML::LoadFile(fontLocation.string()), defaultMode);
+            writeFontImage();
+        }
+        m_InputHash = util::hashData(fontSource.data(), util::hashData(YAML::Dump(config)));
     }
 }
 
-bool Project::parseText()
+bool Project::parseText(Cache* cache)
 {
     fs::path mainDir(m_MainDir);
-    {
+    // Everything below is rebuilt, so a resident project can parse again.
+    nextAddress = 0;
+    m_MessageCount = 0;
+    m_MergedSize = 0;
+    m_Warnings.clear();
+    m_Addresses.clear();
+    m_Labels.clear();
+    m_LabelIds.clear();
+    m_TextNodes.clear();
+    m_TableList.clear();
+    m_PackedData.clear();
+    m_FreeSpace.reset();
+    MemoryFiles previousFiles;
+    previousFiles.swap(m_OutputFiles);
+    if (m_WriteOutput) {
         if (!fs::exists(mainDir / m_OutputDir / m_BinsDir)) {
             if (!fs::exists(mainDir / m_OutputDir)) {
                 fs::create_directory(mainDir / m_OutputDir);
@@ -78,7 +161,7 @@ bool Project::parseText()
             if (!fs::exists(mainDir / m_OutputDir / m_BinsDir)) {
                 fs::create_directory(mainDir / m_OutputDir / m_BinsDir);
             }
-        } else {
+        } else if (m_WrittenFiles.empty()) {
             fs::remove_all(mainDir / m_OutputDir / m_BinsDir / m_TextOutDir);
         }
         fs::create_directory(mainDir / m_OutputDir / m_BinsDir / m_TextOutDir);
@@ -88,6 +171,7 @@ bool Project::parseText()
         fs::path input = fs::path(m_MainDir) / m_InputDir;
         std::vector<std::string> allFiles;
         std::vector<fs::path> dirs;
+        trace::Span scanSpan("scanDirectories");
         std::copy(fs::directory_iterator(input), fs::directory_iterator(), std::back_inserter(dirs));
         std::sort(dirs.begin(), dirs.end());
         for (auto& dir: dirs) {
@@ -96,6 +180,9 @@ bool Project::parseText()
                 if (fs::exists(dir / "table.txt")) {
                     std::string path = (dir / "table.txt").string();
                     std::ifstream tablefile(path);
+                    if (stats::enabled()) {
+                        stats::add(stats::FILES_OPENED);
+                    }
                     fs::path dir(fs::path(path).parent_path());
                     std::string label = dir.filename().string();
                     Table table;
@@ -117,8 +204,11 @@ bool Project::parseText()
                     }
 
                     tablefile.close();
+                    if (table.getUseFreeSpace() && m_FreeSpace.empty()) {
+                        throw ParseError("Error in table " + path + ", data is placed in free space but no freespace regions are declared in the config.");
+                    }
                     m_TableList[label] = table;
-                    m_Addresses.push_back({table.getAddress(), label, true});
+                    m_Addresses.push_back({table.getAddress(), internLabel(label), true});
                 } else {
                     for (auto& fileIt: fs::directory_iterator(dir)) {
                         if(fs::is_regular_file(fileIt.path())) {
@@ -130,239 +220,727 @@ bool Project::parseText()
                 allFiles.insert(allFiles.end(), files.begin(), files.end());
             }
         }
+        scanSpan.finish();
+        // Phase one: encode every file independently of the address it ends up at.
+        // Files whose contents match the cache are replayed instead of parsed.
+        std::vector<EncodedFile> encodedFiles(allFiles.size());
+        std::vector<uint64_t> fileHashes(allFiles.size());
+        uint64_t inputHash = buildDictionaries(allFiles);
+        if (cache) {
+            cache->setInputHash(inputHash);
+        }
+        {
+            unsigned int threadCount = m_ThreadCount > 0 ? m_ThreadCount : std::thread::hardware_concurrency();
+            std::atomic<size_t> nextFile(0), scriptSize(0);
+            auto worker = [&]() {
+                for (size_t index = nextFile++; index < allFiles.size(); index = nextFile++) {
+                    trace::Span span("parseFile", allFiles[index]);
+                    MappedFile script(allFiles[index]);
+                    scriptSize += script.size();
+                    const EncodedFile* cached = nullptr;
+                    if (cache) {
+                        fileHashes[index] = util::hashData(script.data());
+                        cached = cache->findFile(allFiles[index], fileHashes[index]);
+                        if (cached && stats::enabled()) {
+                            stats::add(stats::CACHED_FILES);
+                        }
+                    }
+                    encodedFiles[index] = cached ? *cached : encodeFile(allFiles[index], script.data(), UNRESOLVED_ADDRESS);
+                }
+            };
+            std::vector<std::thread> workers;
+            for (unsigned int i = 1; i < threadCount && i < allFiles.size(); i++) {
+                workers.emplace_back(worker);
+            }
+            worker();
+            for (auto& thread: workers) {
+                thread.join();
+            }
+            m_ScriptSize = scriptSize;
+        }
+        if (cache) {
+            for (size_t index = 0; index < allFiles.size(); index++) {
+                cache->storeFile(allFiles[index], fileHashes[index], encodedFiles[index]);
+            }
+            cache->keepFiles(allFiles);
+        }
+        // Phase two: assign addresses in file order and write the output.
+        // Messages of tables placed in free space wait until every fixed
+        // address is known.
+        std::vector<std::pair<std::string, EncodedMessage>> unplaced;
+        // With merging on, each message is numbered in file order and either
+        // stored or pointed into the message that shares its bytes.
+        std::vector<size_t> hosts, messageSizes;
+        std::vector<int> messageLabels;
+        std::vector<SharedMessage> shared;
+        if (m_MergeMessages) {
+            hosts = findSharedMessages(allFiles, encodedFiles, messageSizes);
+            messageLabels.resize(hosts.size());
+        }
+        size_t messageIndex = 0;
         std::string dir = "";
         int dirIndex;
-        for (auto &file: allFiles) {
+        bool useFreeSpace = false;
+        for (size_t index = 0; index < allFiles.size(); index++) {
+            const std::string& file = allFiles[index];
             if (dir != fs::path(file).parent_path().filename().string()) {
                 dir = fs::path(file).parent_path().filename().string();
                 nextAddress = m_TableList[dir].getDataAddress();
+                useFreeSpace = m_TableList[dir].getUseFreeSpace();
                 dirIndex = 0;
             }
-            std::ifstream input(file);
-            std::vector<unsigned char> data;
-            ParseSettings settings =  m_Parser.getDefaultSetting(nextAddress);
-            int line = 0;
-            while (input) {
-                bool done;
-                int length;
-                try {
-                    std::tie(done, length) = m_Parser.parseLine(input, settings, std::back_inserter(data));
-                    line++;
-                } catch (std::runtime_error &e) {
-                    throw ParseError("Error in text file " + file + ": " + e.what());
+            if (nextAddress == 0) {
+                // Text before an @address is only an error when no address
+                // carries over, so these files are encoded again with the real one.
+                encodedFiles[index] = encodeFile(file, MappedFile(file).data(), nextAddress);
+            }
+            EncodedFile& encoded = encodedFiles[index];
+            m_Warnings.insert(m_Warnings.end(), encoded.warnings.begin(), encoded.warnings.end());
+            if (encoded.error) {
+                std::rethrow_exception(encoded.error);
+            }
+            int currentAddress = nextAddress;
+            bool placed = !useFreeSpace;
+            for (EncodedMessage& message: encoded.messages) {
+                if (message.address != UNRESOLVED_ADDRESS) {
+                    currentAddress = message.address;
+                    placed = true;
                 }
-                if (settings.maxWidth > 0 && length > settings.maxWidth) {
-                    std::ostringstream error;
-                    error << "In " + file + ": line " + std::to_string(line)
-                                 + " is longer than the specified max width of "
-                                 + std::to_string(settings.maxWidth) + " pixels.";
-                    m_Warnings.push_back(error.str());
+                if (message.label.empty()) {
+                    std::ostringstream lstream;
+                    lstream << dir << '_' << dirIndex++;
+                    message.label = lstream.str();
                 }
-                if (done && !data.empty()) {
-                    if (m_Parser.getFonts().at(settings.mode)) {
-                        if (settings.label.empty()) {
-                            std::ostringstream lstream;
-                            lstream << dir << '_' << dirIndex++;
-                            settings.label = lstream.str();
-                        }
-                        m_Addresses.push_back({settings.currentAddress, settings.label, false});
-                        {
-                            int tmpAddress = settings.currentAddress + data.size();
-                            size_t dataLength;
-                            fs::path binFileName = mainDir / m_OutputDir / m_BinsDir / m_TextOutDir / (settings.label + ".bin");
-                            bool printpc = settings.printpc;
-                            if ((tmpAddress & 0xFF0000) != (settings.currentAddress & 0xFF0000)) {
-                                size_t bankLength = ((settings.currentAddress + data.size()) & 0xFFFF);
-                                dataLength = data.size() - bankLength;
-                                fs::path bankFileName = binFileName.parent_path() / (settings.label + "bank.bin");
-                                outputFile(bankFileName.string(), data, bankLength, dataLength);
-                                settings.currentAddress = util::PCToLoROM(util::LoROMToPC(settings.currentAddress | 0xFFFF) +1);
-                                m_Addresses.push_back({settings.currentAddress, "$" + settings.label, false});
-                                settings.currentAddress += bankLength;
-                                m_TextNodeList["$" + settings.label] = {
-                                    bankFileName.filename().string(),
-                                    bankLength,
-                                    printpc
-                                };
-                                printpc = false;
-                            } else {
-                                dataLength = data.size();
-                                settings.currentAddress += data.size();
-                            }
-                            outputFile(binFileName.string(), data, dataLength);
-                            m_TextNodeList[settings.label] = {
-                                binFileName.filename().string(), dataLength, printpc
-                            };
-                        }
-                        settings.label = "";
-                        settings.printpc = false;
-                        data.clear();
+                if (m_MergeMessages) {
+                    messageLabels[messageIndex] = internLabel(message.label);
+                    if (hosts[messageIndex] != messageIndex) {
+                        shared.push_back({messageLabels[messageIndex], messageIndex, hosts[messageIndex]});
+                        messageIndex++;
+                        m_MessageCount++;
+                        continue;
                     }
+                    messageIndex++;
+                }
+                if (placed) {
+                    writeMessage(message, currentAddress, dir);
+                } else {
+                    unplaced.emplace_back(dir, std::move(message));
                 }
+                m_MessageCount++;
             }
-            nextAddress = settings.currentAddress;
-            if (settings.maxWidth < 0) {
-                settings.maxWidth = 0;
+            nextAddress = encoded.endAddress != UNRESOLVED_ADDRESS ? encoded.endAddress : currentAddress;
+        }
+        allocateMessages(unplaced);
+        placeSharedMessages(shared, messageLabels, messageSizes);
+        if (!m_LinkOutput) {
+            for (auto& blob: m_PackedData) {
+                outputFile((mainDir / m_OutputDir / m_BinsDir / m_TextOutDir / (blob.first + ".bin")).string(), std::move(blob.second));
             }
+            m_PackedData.clear();
         }
     }
 
     {
-        std::ofstream mainText((mainDir / m_OutputDir / "text.asm").string());
-        std::ofstream textDefines((mainDir / m_OutputDir / "textDefines.exp").string());
-        if (!mainText || !textDefines) {
-            throw ASMError("Could not open files in " + (mainDir / m_OutputDir).string() + " for writing.\n");
-        }
+        trace::Span span("emitText");
+        std::string mainText, textDefines;
+        mainText.reserve(m_Addresses.size() * 64);
+        textDefines.reserve(m_Addresses.size() * 32);
+        std::string binPath = (fs::path(m_BinsDir) / m_TextOutDir / "").string();
 
-        std::sort(m_Addresses.begin(), m_Addresses.end(), [](AddressNode a, AddressNode b) {
-            return b.address > a.address;
-        });
-        //int lastPosition = 0;
-        for (auto& it : m_Addresses) {
-            //int dif = it.address - lastPosition;
+        sortAddresses(m_Addresses);
+        std::vector<int> labelAddresses;
+        m_TextBlocks.clear();
+        if (m_LinkOutput) {
+            labelAddresses.resize(m_Labels.size(), UNRESOLVED_ADDRESS);
+            for (const AddressNode& it : m_Addresses) {
+                labelAddresses[it.label] = it.address;
+            }
+        }
+        for (const AddressNode& it : m_Addresses) {
+            const std::string& label = m_Labels[it.label];
             if (it.isTable) {
-                textDefines << "!def_table_" + it.label + " = $" << std::hex << it.address << '\n';
-                mainText  << "ORG !def_table_" + it.label + '\n';
-                Table t = m_TableList.at(it.label);
-                mainText << "table_" + it.label + ":\n";
-                for (auto it : t) {
-                    int size;
-                    std::string dataType;
-                    if (t.getAddressSize() == 3) {
-                        dataType = "dl";
-                    } else if(t.getAddressSize() == 2) {
-                        dataType = "dw";
+                textDefines.append("!def_table_").append(label).append(" = $");
+                appendHex(textDefines, it.address);
+                textDefines += '\n';
+                mainText.append("ORG !def_table_").append(label).append("\ntable_").append(label).append(":\n");
+                Table& t = m_TableList.at(label);
+                const char* dataType;
+                if (t.getAddressSize() == 3) {
+                    dataType = "dl ";
+                } else if(t.getAddressSize() == 2) {
+                    dataType = "dw ";
+                } else {
+                    throw std::logic_error("Unsupported address size " + std::to_string(t.getAddressSize()));
+                }
+                std::string pointers;
+                for (auto entry = t.begin(); entry != t.end(); ++entry) {
+                    int address;
+                    size_t size;
+                    if (entry->address > 0) {
+                        address = entry->address;
+                        size = entry->size;
                     } else {
-                        throw std::logic_error("Unsupported address size " + std::to_string(t.getAddressSize()));
+                        auto id = m_LabelIds.find(entry->label);
+                        if (id == m_LabelIds.end() || m_TextNodes[id->second].files.empty()) {
+                            throw ParseError("Table " + label + " refers to " + entry->label + ", which is not the label of any message.");
+                        }
+                        address = m_LinkOutput ? labelAddresses[id->second] : 0;
+                        size = m_TextNodes[id->second].size;
                     }
-                    if (it.address > 0) {
-                        mainText << dataType + " $" << std::setw(4) << std::setfill('0') << std::hex << it.address;
-                        size = it.size;
+                    if (m_LinkOutput) {
+                        // Little endian, truncated like Asar's dl and dw.
+                        for (int i = 0; i < t.getAddressSize(); i++) {
+                            pointers += (char)(address >> (8 * i));
+                        }
+                        if (t.getStoreWidths()) {
+                            for (int i = 0; i < t.getAddressSize(); i++) {
+                                pointers += (char)(size >> (8 * i));
+                            }
+                        }
+                        continue;
+                    }
+                    mainText.append(dataType);
+                    if (entry->address > 0) {
+                        mainText += '$';
+                        appendHex(mainText, entry->address, 4);
                     } else {
-                        mainText << dataType + ' ' + it.label;
-                        size = m_TextNodeList.at(it.label).size;
+                        mainText.append(entry->label);
                     }
                     if (t.getStoreWidths()) {
-                        mainText << ", " << std::dec << size;
+                        mainText.append(", ").append(std::to_string(size));
                     }
-                    mainText << '\n';
+                    mainText += '\n';
                 }
+                addLinkData(m_TextBlocks, it.address, pointers.data(), pointers.size());
             } else {
-                if (it.label.front() == '$') {
-                    mainText  << "ORG $" << std::hex << it.address << '\n';
+                const TextNode& node = m_TextNodes[it.label];
+                if (label.front() == '$') {
+                    mainText.append("ORG $");
+                    appendHex(mainText, it.address);
+                    mainText += '\n';
                 } else {
-                    textDefines << "!def_" + it.label + " = $" << std::hex << it.address << '\n';
-                    mainText  << "ORG !def_" + it.label + '\n'
-                              << it.label + ":\n";
-
+                    textDefines.append("!def_").append(label).append(" = $");
+                    appendHex(textDefines, it.address);
+                    textDefines += '\n';
+                    mainText.append("ORG !def_").append(label).append("\n").append(label).append(":\n");
                 }
-                std::string token = m_TextNodeList.at(it.label).files;
-                mainText << "incbin " + (fs::path(m_BinsDir) / m_TextOutDir / token).string() + '\n';
-                if (m_TextNodeList.at(it.label).printpc) {
-                    mainText << "print pc\n";
+                if (m_LinkOutput && !node.shared) {
+                    addLinkData(m_TextBlocks, it.address, m_PackedData.at(node.files).data() + node.offset, node.size);
+                    if (node.printpc) {
+                        mainText.append("ORG $");
+                        appendHex(mainText, it.address + node.size);
+                        mainText.append("\nprint pc\n");
+                    }
+                } else if (node.size > 0 && !node.shared) {
+                    mainText.append("incbin ").append(binPath).append(node.files);
+                    if (m_PackedOutput) {
+                        // Asar ranges are hexadecimal and exclude the end offset.
+                        mainText += ':';
+                        appendHex(mainText, node.offset);
+                        mainText += '-';
+                        appendHex(mainText, node.offset + node.size);
+                    }
+                    mainText += '\n';
+                }
+                if (node.printpc && !m_LinkOutput) {
+                    mainText.append("print pc\n");
                 }
             }
-            mainText << '\n';
+            mainText += '\n';
         }
-        textDefines.flush();
-        textDefines.close();
-        mainText.flush();
-        mainText.close();
-        fs::path mainDir(m_MainDir);
+        m_PackedData.clear();
+        outputFile((mainDir / m_OutputDir / "textDefines.exp").string(), std::move(textDefines));
+        outputFile((mainDir / m_OutputDir / "text.asm").string(), std::move(mainText));
+        std::string sharedSource = sharedPatchSource();
         for (Rom& romData: m_Roms) {
             std::string patchFile = (mainDir / (romData.name + ".asm")).string();
-            std::ofstream mainFile(patchFile);
-            mainFile << "lorom\n\n";
-            if (!romData.includes.empty()) {
-                for (std::string& include: romData.includes) {
-                    mainFile << "incsrc " + m_OutputDir + '/' + include << '\n';
+            outputFile(patchFile, "lorom\n\n" + romIncludeSource(romData) + sharedSource);
+        }
+        writeFontData();
+    }
+    if (stats::enabled()) {
+        stats::add(stats::MESSAGES, m_MessageCount);
+    }
+    // Files from the last build that this one did not produce are stale.
+    for (auto& file: previousFiles) {
+        if (m_OutputFiles.count(file.first) == 0 && m_WrittenFiles.erase(file.first) > 0) {
+            fs::remove(file.first);
+        }
+    }
+    return true;
+}
+
+void Project::writePatchData()
+{
+    unsigned int jobs = m_ThreadCount > 0 ? m_ThreadCount : std::thread::hardware_concurrency();
+    fs::path mainDir(m_MainDir);
+    // Each patch is the ROM's own includes followed by the part every ROM
+    // shares. Where the scan finds nothing that lets one change what the
+    // other assembles to, the shared part is assembled once and each ROM
+    // only assembles its own includes on top of the result.
+    std::vector<bool> useShared(m_Roms.size(), false);
+    std::vector<std::string> patchSources;
+    if (m_SharedAssembly && m_Roms.size() > 1) {
+        for (size_t index = 0; index < m_Roms.size(); index++) {
+            int found = 0;
+            for (const std::string& include: m_Roms[index].includes) {
+                found |= scanAsmDependencies((mainDir / m_OutputDir / include).string(), m_OutputFiles);
+            }
+            useShared[index] = (found & (READS_ROM | SETS_STATE | UNKNOWN_SOURCE)) == 0;
+        }
+    }
+    if (std::count(useShared.begin(), useShared.end(), true) > 1) {
+        int found = 0;
+        for (const std::string& include: sharedIncludes()) {
+            found |= scanAsmDependencies((mainDir / include).string(), m_OutputFiles);
+        }
+        if ((found & (READS_ROM | CHECKS_DEFINES | UNKNOWN_SOURCE)) == 0) {
+            // Written before anything else in the shared part, so code that
+            // would have followed on from a ROM's includes without an org
+            // cannot assemble.
+            std::string source = "lorom\n\norg $";
+            appendHex(source, SHARED_PATCH_ORIGIN);
+            m_OutputFiles[sharedPatchFile()] = source + '\n' + sharedPatchSource();
+            patchSources.push_back(sharedPatchFile());
+            for (size_t index = 0; index < m_Roms.size(); index++) {
+                if (useShared[index]) {
+                    m_OutputFiles[romIncludesFile(m_Roms[index])] = "lorom\n\n" + romIncludeSource(m_Roms[index]);
+                    patchSources.push_back(romIncludesFile(m_Roms[index]));
                 }
             }
-            if (!m_Includes.empty()) {
-                for (std::string& include: m_Includes) {
-                    mainFile << "incsrc " + m_OutputDir + '/' + include << '\n';
+        }
+    }
+    // The workers write the ROMs, so the files they write are recorded here
+    // for watch mode to ignore.
+    for (const Rom& romData: m_Roms) {
+        fs::path romFile = fs::absolute(outputRomFile(romData)).lexically_normal();
+        m_PatchedFiles.insert(romFile.string());
+        m_PatchedFiles.insert(fs::path(romFile).replace_extension(".ips").string());
+        m_PatchedFiles.insert(fs::path(romFile).replace_extension(".bps").string());
+    }
+    PatchResult shared;
+    std::vector<std::string> results;
+    try {
+        bool hasShared = !patchSources.empty() && assembleSharedPatch(shared);
+        results = runWorkers(m_Roms.size(), jobs, [&](const std::vector<size_t>& indices) {
+            return patchRoms(indices, hasShared ? &shared : nullptr, useShared);
+        });
+    } catch (...) {
+        for (const std::string& file: patchSources) {
+            m_OutputFiles.erase(file);
+        }
+        throw;
+    }
+    for (const std::string& file: patchSources) {
+        m_OutputFiles.erase(file);
+    }
+    // Every ROM has been assembled by now, and the ones that succeeded have
+    // been written, so each one is reported before the failures are thrown.
+    bool failed = false;
+    std::ostringstream errors;
+    for (size_t index = 0; index < m_Roms.size(); index++) {
+        const std::string& result = results[index];
+        if (result.empty()) {
+            failed = true;
+            errors << "Assembly for " << m_Roms[index].name << " did not finish.\n";
+            continue;
+        }
+        std::vector<std::string> messages;
+        size_t start = 1;
+        for (size_t end; start < result.size() && result[start] != PATCH_TRACE
+             && (end = result.find('\0', start)) != std::string::npos; start = end + 1) {
+            messages.push_back(result.substr(start, end - start));
+        }
+        if (start < result.size() && result[start] == PATCH_TRACE) {
+            trace::addEvents(std::string_view(result).substr(start + 1));
+        }
+        if (result.front() == PATCH_SUCCESS) {
+            std::cout << "Assembly for " << m_Roms[index].name << " completed successfully." << std::endl;
+            for (auto& msg: messages) {
+                std::cout << msg << std::endl;
+            }
+        } else if (result.front() == PATCH_EXCEPTION) {
+            failed = true;
+            if (!messages.empty()) {
+                errors << messages.front() << '\n';
+            }
+        } else if (!messages.empty()) {
+            failed = true;
+            errors << messages.front() << '\n';
+        }
+    }
+    if (failed) {
+        throw ASMError(errors.str());
+    }
+}
+
+std::vector<std::string> Project::patchRoms(const std::vector<size_t> &indices, const PatchResult* shared, const std::vector<bool>& useShared) const
+{
+    // The next ROM is read and the previous one written while Asar assembles
+    // the current one.
+    auto save = [this](const std::string& path, const std::string& basePath, std::unique_ptr<RomPatcher> rom) {
+        if (m_PatchFormats != 0) {
+            // Made before the ROM is written, which may replace the base ROM.
+            trace::Span span("writeDeltaPatch", path);
+            MappedFile base(basePath);
+            if (!base) {
+                return "Could not read " + basePath + " to make a patch.";
+            }
+            std::string_view target((const char*)&rom->at(0), rom->getRealSize());
+            ByteRanges changed = rom->getChangedRanges();
+            for (PatchFormat format: {IPS_PATCH, BPS_PATCH}) {
+                if ((m_PatchFormats & format) == 0) {
+                    continue;
+                }
+                std::string patchPath = fs::path(path).replace_extension(format == IPS_PATCH ? ".ips" : ".bps").string();
+                std::string patch = format == IPS_PATCH
+                        ? makeIpsPatch(base.data(), target, changed)
+                        : makeBpsPatch(base.data(), target, changed);
+                std::ofstream output(patchPath, std::ios::out | std::ios::binary);
+                output.write(patch.data(), patch.size());
+                output.close();
+                if (output.fail()) {
+                    return "Could not write " + patchPath + '.';
                 }
             }
-            if (!m_Extras.empty()) {
-                for (std::string& include: m_Extras) {
-                    mainFile << "incsrc " + m_OutputDir + '/'
-                                + m_BinsDir + '/' + include + '/' + include + ".asm"
-                             << '\n';
+        }
+        trace::Span span("writeRom", path);
+        return rom->save(path) ? std::string() : "Could not write " + path + '.';
+    };
+    std::vector<std::string> results(indices.size());
+    std::future<std::unique_ptr<RomPatcher>> nextRom;
+    std::future<std::string> writing;
+    size_t writingIndex = 0;
+    auto finishWriting = [&]() {
+        if (writing.valid()) {
+            std::string error = writing.get();
+            if (!error.empty()) {
+                results[writingIndex] = std::string(1, PATCH_EXCEPTION) + error + '\0';
+            }
+        }
+    };
+    // Asar's written blocks never overlap, so sorted by start they are also
+    // sorted by end.
+    ByteRanges sharedRanges;
+    std::unordered_set<std::string> sharedLabels;
+    if (shared != nullptr) {
+        for (auto& block: shared->blocks) {
+            sharedRanges.emplace_back(block.first, block.first + block.second.size());
+        }
+        std::sort(sharedRanges.begin(), sharedRanges.end());
+        for (auto& label: shared->labels) {
+            sharedLabels.insert(label.first);
+        }
+    }
+    if (!indices.empty()) {
+        nextRom = std::async(std::launch::async, &Project::loadRom, this, indices.front());
+    }
+    fs::path mainDir(m_MainDir);
+    for (size_t i = 0; i < indices.size(); i++) {
+        const Rom& romData = m_Roms[indices[i]];
+        std::string& result = results[i];
+        std::future<std::unique_ptr<RomPatcher>> currentRom = std::move(nextRom);
+        if (i + 1 < indices.size()) {
+            nextRom = std::async(std::launch::async, &Project::loadRom, this, indices[i + 1]);
+        }
+        try {
+            std::unique_ptr<RomPatcher> r = currentRom.get();
+            prepareRom(*r);
+            bool success = false;
+            std::vector<std::string> messages;
+            if (shared != nullptr && useShared[indices[i]]) {
+                // The ROM's includes are assembled after the shared blocks
+                // are written instead of before, which only gives the same
+                // ROM if they write different bytes and define different
+                // labels. Otherwise it is assembled in full.
+                if (r->writePatchResult(*shared) && r->applyPatchFile(romIncludesFile(romData), m_OutputFiles)) {
+                    PatchResult own = r->getPatchResult();
+                    success = std::none_of(own.blocks.begin(), own.blocks.end(), [&](const std::pair<int, std::string>& block) {
+                        size_t start = block.first, end = start + block.second.size();
+                        auto next = std::lower_bound(sharedRanges.begin(), sharedRanges.end(), std::make_pair(end, (size_t)0));
+                        return next != sharedRanges.begin() && std::prev(next)->second > start;
+                    }) && std::none_of(own.labels.begin(), own.labels.end(), [&](const std::pair<std::string, int>& label) {
+                        return sharedLabels.count(label.first) > 0;
+                    });
+                    if (success) {
+                        trace::Span span("useSharedPatch", romData.name);
+                        messages = std::move(own.prints);
+                        messages.insert(messages.end(), shared->prints.begin(), shared->prints.end());
+                    }
                 }
+                if (!success) {
+                    // Prepared again instead of copied beforehand, as the
+                    // base ROM is mapped copy-on-write and most ROMs never
+                    // get here.
+                    r = loadRom(indices[i]);
+                    prepareRom(*r);
+                }
+            }
+            if (!success) {
+                std::string patchFile = (mainDir / (romData.name + ".asm")).string();
+                success = r->applyPatchFile(patchFile, m_OutputFiles);
+                r->getMessages(std::back_inserter(messages));
             }
-            if (!m_FontDir.empty()) {
-                mainFile << "incsrc " + m_OutputDir + '/'
-                            + m_BinsDir + '/' + m_FontDir + '/' + m_FontDir + ".asm"
-                         << '\n';
+            result = success ? PATCH_SUCCESS : PATCH_ASM_ERROR;
+            for (auto& msg: messages) {
+                result += msg + '\0';
+            }
+            if (success) {
+                finishWriting();
+                writingIndex = i;
+                writing = std::async(
+                            std::launch::async,
+                            save,
+                            outputRomFile(romData),
+                            (fs::path(m_RomsDir) / romData.file).string(),
+                            std::move(r)
+                            );
             }
-            mainFile <<  "incsrc " + m_OutputDir + "/textDefines.exp\n"
-                        +  "incsrc " + m_OutputDir + "/text.asm\n";
-            mainFile.close();
+        } catch (std::exception &e) {
+            result = std::string(1, PATCH_EXCEPTION) + e.what() + '\0';
         }
-        writeFontData();
     }
-    return true;
+    finishWriting();
+    if (trace::enabled() && !results.empty()) {
+        results.back() += PATCH_TRACE + trace::takeEvents();
+    }
+    return results;
 }
 
-void Project::writePatchData()
+std::string Project::outputRomFile(const Rom &romData) const
 {
-    fs::path mainDir(m_MainDir);
-    for (Rom& romData: m_Roms) {
-        std::string patchFile = (mainDir / (romData.name + ".asm")).string();
+    std::string extension = fs::path(romData.file).extension().string();
+    return (fs::path(m_RomsDir) / (romData.name + extension)).string();
+}
 
-        fs::path romFilePath = fs::path(m_RomsDir) / romData.file;
-        std::string extension = romFilePath.extension().string();
-        RomPatcher r(
-                     romFilePath.string(),
+std::unique_ptr<RomPatcher> Project::loadRom(size_t index) const
+{
+    trace::Span span("loadRom", m_Roms[index].name);
+    if (index < m_BaseRoms.size()) {
+        return std::make_unique<RomPatcher>(m_BaseRoms[index]);
+    }
+    const Rom& romData = m_Roms[index];
+    return std::make_unique<RomPatcher>(
+                (fs::path(m_RomsDir) / romData.file).string(),
+                romData.name,
+                "lorom",
+                romData.hasHeader
+                );
+}
+
+void Project::prepareRom(RomPatcher &rom) const
+{
+    int romEnd = util::LoROMToPC(getMaxAddress());
+    for (auto* blocks: {&m_TextBlocks, &m_FontBlocks}) {
+        for (const LinkBlock& block: *blocks) {
+            romEnd = std::max(romEnd, (int)(util::LoROMToPC(block.address) + block.data.size()));
+        }
+    }
+    {
+        trace::Span span("expand", rom.getName());
+        rom.expand(romEnd);
+    }
+    // Linked data goes in first so Asar's checksum covers it.
+    for (auto* blocks: {&m_TextBlocks, &m_FontBlocks}) {
+        for (const LinkBlock& block: *blocks) {
+            rom.writeData(block.address, block.data.data(), block.data.size());
+        }
+    }
+}
+
+bool Project::assembleSharedPatch(PatchResult &result) const
+{
+    trace::Span span("assembleShared");
+    try {
+        // The first ROM only gives Asar somewhere to write, as the scan ruled
+        // out anything that reads it.
+        std::unique_ptr<RomPatcher> rom = loadRom(0);
+        prepareRom(*rom);
+        if (!rom->applyPatchFile(sharedPatchFile(), m_OutputFiles)) {
+            return false;
+        }
+        result = rom->getPatchResult();
+    } catch (std::exception&) {
+        return false;
+    }
+    // The ROM's includes are assembled in LoROM as well, and a different
+    // mapper would move the checksum Asar fixes after them.
+    if (result.mapper != Mapper::LOROM) {
+        return false;
+    }
+    return std::none_of(result.labels.begin(), result.labels.end(), [](const std::pair<std::string, int>& label) {
+        return label.second >= SHARED_PATCH_ORIGIN && label.second < SHARED_PATCH_ORIGIN + 0x100;
+    });
+}
+
+std::vector<std::string> Project::sharedIncludes() const
+{
+    // Relative to the main directory, in the order the patches include them.
+    std::vector<std::string> includes;
+    for (const std::string& include: m_Includes) {
+        includes.push_back(m_OutputDir + '/' + include);
+    }
+    for (const std::string& include: m_Extras) {
+        includes.push_back(m_OutputDir + '/' + m_BinsDir + '/' + include + '/' + include + ".asm");
+    }
+    if (!m_FontDir.empty()) {
+        includes.push_back(m_OutputDir + '/' + m_BinsDir + '/' + m_FontDir + '/' + m_FontDir + ".asm");
+    }
+    return includes;
+}
+
+std::string Project::sharedPatchSource() const
+{
+    std::string source;
+    for (const std::string& include: sharedIncludes()) {
+        source += "incsrc " + include + '\n';
+    }
+    source += "incsrc " + m_OutputDir + "/textDefines.exp\n";
+    source += "incsrc " + m_OutputDir + "/text.asm\n";
+    return source;
+}
+
+std::string Project::romIncludeSource(const Rom &romData) const
+{
+    std::string source;
+    for (const std::string& include: romData.includes) {
+        source += "incsrc " + m_OutputDir + '/' + include + '\n';
+    }
+    return source;
+}
+
+std::string Project::sharedPatchFile() const
+{
+    // Only ever a memory file. Hidden names so they cannot be a ROM's patch.
+    return fs::absolute(fs::path(m_MainDir) / ".shared.asm").string();
+}
+
+std::string Project::romIncludesFile(const Rom &romData) const
+{
+    return fs::absolute(fs::path(m_MainDir) / ('.' + romData.name + ".includes.asm")).string();
+}
+
+void Project::loadRoms()
+{
+    m_BaseRoms.clear();
+    m_BaseRoms.reserve(m_Roms.size());
+    for (const Rom& romData: m_Roms) {
+        RomPatcher rom(
+                    (fs::path(m_RomsDir) / romData.file).string(),
                     romData.name,
                     "lorom",
                     romData.hasHeader
                     );
-        r.expand(util::LoROMToPC(getMaxAddress()));
-        auto result = r.applyPatchFile(patchFile);
-        if (result) {
-            std::cout << "Assembly for " << romData.name << " completed successfully." << std::endl;
+        // A copy no longer maps the file, so the resident ROM stays the same
+        // while the file is edited.
+        m_BaseRoms.push_back(rom);
+    }
+}
+
+std::vector<std::pair<std::string, bool>> Project::getWatchDirectories() const
+{
+    fs::path mainDir(m_MainDir);
+    return {
+        {m_ProjectDir, false},
+        {fs::path(m_FontFile).parent_path().string(), false},
+        {(mainDir / m_InputDir).string(), true},
+        {m_MainDir, false},
+        {(mainDir / m_OutputDir).string(), true},
+        {m_RomsDir, false}
+    };
+}
+
+Project::Change Project::classifyChange(const std::string &path) const
+{
+    fs::path file = fs::absolute(path).lexically_normal();
+    auto isBelow = [&file](const fs::path& dir) {
+        fs::path relative = file.lexically_relative(fs::absolute(dir).lexically_normal());
+        return !relative.empty() && *relative.begin() != "..";
+    };
+    fs::path mainDir(m_MainDir);
+    std::vector<std::string> configFiles = getConfigFiles();
+    if (std::find(configFiles.begin(), configFiles.end(), file.string()) != configFiles.end()) {
+        return CONFIG_CHANGE;
+    } else if (isBelow(mainDir / m_OutputDir / m_BinsDir / m_TextOutDir)) {
+        return NO_CHANGE;
+    }
+    for (auto& output: m_OutputFiles) {
+        if (fs::path(output.first).lexically_normal() == file) {
+            return NO_CHANGE;
         }
-        std::vector<std::string> messages;
-        r.getMessages(std::back_inserter(messages));
-        if (result) {
-            for (auto& msg: messages) {
-                std::cout << msg << std::endl;
-            }
-            std::ofstream output(
-                        (fs::path(m_RomsDir) / (romData.name + extension)).string(),
-                        std::ios::out|std::ios::binary
-                        );
-            output.write((char*)&r.at(0), r.getRealSize());
-            output.close();
-        } else {
-            for (auto& msg: messages) {
-                std::ostringstream error;
-                error << msg << '\n';
-                throw ASMError(error.str());
+    }
+    if (m_PatchedFiles.count(file.string()) > 0) {
+        return NO_CHANGE;
+    }
+    if (isBelow(mainDir / m_InputDir)) {
+        return SCRIPT_CHANGE;
+    } else if (file.parent_path() == fs::absolute(m_RomsDir).lexically_normal()) {
+        // Patched ROMs are written next to the base ROMs they came from.
+        for (const Rom& romData: m_Roms) {
+            if (file.filename() == romData.file) {
+                return ROM_CHANGE;
             }
         }
-
+        return NO_CHANGE;
+    } else if (isBelow(mainDir / m_OutputDir) || file.parent_path() == fs::absolute(mainDir).lexically_normal()) {
+        return ASM_CHANGE;
     }
+    return NO_CHANGE;
+}
+
+std::vector<std::string> Project::getConfigFiles() const
+{
+    return {(fs::path(m_ProjectDir) / "config.yml").string(), m_FontFile};
+}
+
+EncodedFile Project::encodeScript(std::string_view script) const
+{
+    return encodeFile("script", script, UNRESOLVED_ADDRESS);
 }
 
 void Project::writeFontData()
 {
+    trace::Span span("writeFontData");
     fs::path fontFilePath = fs::path(m_MainDir) / m_OutputDir / m_BinsDir / m_FontDir / (m_FontDir + ".asm");
-    std::ofstream output(fontFilePath.string());
-    if (!output) {
-        throw ASMError("Could not open " + fontFilePath.string() + "for writing.\n");
-    }
+    std::ostringstream output;
     for (std::string& include: m_FontIncludes) {
         output << "incsrc " + include + ".asm\n";
     }
+    m_FontBlocks.clear();
     for (auto& fontIt: m_Parser.getFonts()) {
-        if (!fontIt.second.getFontWidthLocation().empty()) {
-            output << "\n"
-                      "ORG " + fontIt.second.getFontWidthLocation();
+        const std::string& dictionaryLocation = fontIt.second.getDictionaryLocation();
+        if (!dictionaryLocation.empty() && !fontIt.second.getDictionary().empty()) {
+            std::string table = fontIt.second.getDictionaryTable();
+            if (m_LinkOutput && dictionaryLocation.front() == '$' && util::strToHex(dictionaryLocation).second != -1) {
+                addLinkData(m_FontBlocks, util::strToHex(dictionaryLocation).first, table.data(), table.size());
+            } else {
+                output << "\n"
+                          "ORG " + dictionaryLocation;
+                for (size_t i = 0; i < table.size(); i++) {
+                    output << (i % 16 == 0 ? "\ndb " : ", ")
+                           << "$" << std::hex << std::setw(2) << std::setfill('0') << (table[i] & 0xFF);
+                }
+                output << '\n';
+            }
+        }
+        const std::string& location = fontIt.second.getFontWidthLocation();
+        if (!location.empty()) {
             std::vector<int> widths;
             widths.reserve(fontIt.second.getMaxEncodedValue());
             fontIt.second.getFontWidths(std::back_insert_iterator(widths));
+            // Only literal addresses can be linked, defines are left to Asar.
+            if (m_LinkOutput && location.front() == '$' && util::strToHex(location).second != -1) {
+                int address = util::strToHex(location).first;
+                for (size_t i = 0; i < widths.size(); i++) {
+                    if (widths[i] != 0) {
+                        char width = (char)widths[i];
+                        addLinkData(m_FontBlocks, address + i, &width, 1);
+                    }
+                }
+                continue;
+            }
+            output << "\n"
+                      "ORG " + location;
             int column = 0;
             int skipCount = 0;
             for (auto it = widths.begin(); it != widths.end(); ++it) {
@@ -391,7 +969,23 @@ void Project::writeFontData()
             output << '\n' ;
         }
     }
+    outputFile(fontFilePath.string(), output.str());
+}
+
+bool Project::writeFontImage() const
+{
+    fs::path imageFile(m_FontImageFile);
+    if (!fs::exists(imageFile.parent_path())) {
+        fs::create_directory(imageFile.parent_path());
+    }
+    std::ofstream output(imageFile.string(), std::ios::binary);
+    if (!output) {
+        return false;
+    }
+    std::string image = m_Parser.getFontImage(m_FontHash);
+    output.write(image.data(), image.size());
     output.close();
+    return true;
 }
 
 std::string Project::MainDir() const
@@ -422,6 +1016,26 @@ int Project::getMaxAddress() const
     return m_Addresses.back().address;
 }
 
+size_t Project::getScriptSize() const
+{
+    return m_ScriptSize;
+}
+
+size_t Project::getMessageCount() const
+{
+    return m_MessageCount;
+}
+
+size_t Project::getMergedSize() const
+{
+    return m_MergedSize;
+}
+
+const std::vector<FreeSpace::Region> &Project::getFreeSpace() const
+{
+    return m_FreeSpace.getRegions();
+}
+
 int Project::getWarningCount() const
 {
     return m_Warnings.size();
@@ -437,21 +1051,371 @@ sable::Project::operator bool() const
     return !m_MainDir.empty();
 }
 
+void Project::setThreadCount(unsigned int threadCount)
+{
+    m_ThreadCount = threadCount;
+}
+
+void Project::setWriteOutput(bool writeOutput)
+{
+    m_WriteOutput = writeOutput;
+}
+
+void Project::setPackedOutput(bool packedOutput)
+{
+    m_PackedOutput = packedOutput;
+}
+
+void Project::setLinkOutput(bool linkOutput)
+{
+    m_LinkOutput = linkOutput;
+}
+
+void Project::setMergeMessages(bool mergeMessages)
+{
+    m_MergeMessages = mergeMessages;
+}
+
+void Project::setPatchFormats(unsigned int patchFormats)
+{
+    m_PatchFormats = patchFormats;
+}
+
+void Project::setSharedAssembly(bool sharedAssembly)
+{
+    m_SharedAssembly = sharedAssembly;
+}
+
+const MemoryFiles &Project::getOutputFiles() const
+{
+    return m_OutputFiles;
+}
+
+uint64_t Project::buildDictionaries(const std::vector<std::string> &files)
+{
+    trace::Span span("buildDictionaries");
+    // Fonts with a dictionary are analysed on their own encoding, so the
+    // dictionary from an earlier run is removed first.
+    std::vector<std::string> fonts;
+    for (auto& font: m_Parser.getFonts()) {
+        if (!font.second.getDictionaryLocation().empty()) {
+            fonts.push_back(font.first);
+        }
+    }
+    if (fonts.empty()) {
+        return m_InputHash;
+    }
+    for (const std::string& font: fonts) {
+        m_Parser.setDictionary(font, {});
+    }
+    // Every script is encoded again afterwards, which is what gets counted.
+    stats::Pause pause;
+    unsigned int threadCount = m_ThreadCount > 0 ? m_ThreadCount : std::thread::hardware_concurrency();
+    threadCount = std::max(threadCount, 1u);
+    // Runs are kept per file so the dictionary does not depend on which
+    // thread parsed which file.
+    std::vector<std::map<std::string, std::vector<std::string>>> runs(files.size());
+    std::atomic<size_t> nextFile(0);
+    auto worker = [&]() {
+        for (size_t index = nextFile++; index < files.size(); index = nextFile++) {
+            std::map<std::string, std::vector<std::string>>& found = runs[index];
+            MappedFile script(files[index]);
+            std::vector<unsigned char> data;
+            ParseSettings settings = m_Parser.getDefaultSetting(UNRESOLVED_ADDRESS);
+            settings.textSink = [&found](const std::string& mode, std::string_view text) {
+                found[mode].emplace_back(text);
+            };
+            try {
+                m_Parser.parseBuffer(script.data(), settings, std::back_inserter(data), [&data](bool, int, int) {
+                    data.clear();
+                });
+            } catch (std::exception&) {
+                // Errors are reported when the file is encoded.
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threadCount && i < files.size(); i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread: workers) {
+        thread.join();
+    }
+    // The dictionaries decide the encoding, so cached files are only valid
+    // for the same ones.
+    uint64_t hash = m_InputHash;
+    for (const std::string& font: fonts) {
+        std::vector<std::string> fontRuns;
+        for (auto& found: runs) {
+            auto text = found.find(font);
+            if (text != found.end()) {
+                std::move(text->second.begin(), text->second.end(), std::back_inserter(fontRuns));
+            }
+        }
+        std::vector<Font::DictionaryEntry> dictionary = buildDictionary(m_Parser.getFonts().at(font), fontRuns, threadCount);
+        for (auto& entry: dictionary) {
+            hash = util::hashData(entry.text, hash + entry.code);
+        }
+        m_Parser.setDictionary(font, std::move(dictionary));
+    }
+    return hash;
+}
+
+EncodedFile Project::encodeFile(const std::string &file, std::string_view script, int startAddress) const
+{
+    EncodedFile encoded;
+    std::vector<unsigned char> data;
+    ParseSettings settings = m_Parser.getDefaultSetting(startAddress);
+    try {
+        m_Parser.parseBuffer(script, settings, std::back_inserter(data), [&](bool done, int length, int line) {
+            if (settings.maxWidth > 0 && length > settings.maxWidth) {
+                std::ostringstream error;
+                error << "In " + file + ": line " + std::to_string(line)
+                             + " is longer than the specified max width of "
+                             + std::to_string(settings.maxWidth) + " pixels.";
+                encoded.warnings.push_back(error.str());
+                if (stats::enabled()) {
+                    stats::add(stats::WIDTH_WARNINGS);
+                }
+            }
+            if (done && !data.empty()) {
+                if (m_Parser.getFonts().at(settings.mode)) {
+                    encoded.messages.push_back({settings.label, settings.currentAddress, settings.printpc, std::move(data)});
+                    settings.label = "";
+                    settings.printpc = false;
+                    settings.currentAddress = UNRESOLVED_ADDRESS;
+                    data.clear();
+                }
+            }
+        });
+        encoded.endAddress = settings.currentAddress;
+    } catch (std::runtime_error &e) {
+        encoded.error = std::make_exception_ptr(ParseError("Error in text file " + file + ": " + e.what()));
+    } catch (...) {
+        encoded.error = std::current_exception();
+    }
+    return encoded;
+}
+
+int Project::internLabel(const std::string &label)
+{
+    auto id = m_LabelIds.emplace(label, m_Labels.size());
+    if (id.second) {
+        m_Labels.push_back(label);
+        m_TextNodes.emplace_back();
+    }
+    return id.first->second;
+}
+
+void Project::writeMessage(const EncodedMessage &message, int &currentAddress, const std::string& dir)
+{
+    const std::vector<unsigned char>& data = message.data;
+    int id = internLabel(message.label);
+    m_Addresses.push_back({currentAddress, id, false});
+    int tmpAddress = currentAddress + data.size();
+    size_t dataLength;
+    bool printpc = message.printpc;
+    if (stats::enabled()) {
+        stats::add(stats::BYTES_WRITTEN, dir, data.size());
+    }
+    if ((tmpAddress & 0xFF0000) != (currentAddress & 0xFF0000)) {
+        if (stats::enabled()) {
+            stats::add(stats::BANK_SPLITS);
+        }
+        size_t bankLength = ((currentAddress + data.size()) & 0xFFFF);
+        dataLength = data.size() - bankLength;
+        currentAddress = util::PCToLoROM(util::LoROMToPC(currentAddress | 0xFFFF) +1);
+        int bankId = internLabel("$" + message.label);
+        m_Addresses.push_back({currentAddress, bankId, false});
+        currentAddress += bankLength;
+        m_TextNodes[bankId] = storeMessageData(message.label + "bank", dir, data, bankLength, dataLength, printpc);
+        printpc = false;
+    } else {
+        dataLength = data.size();
+        currentAddress += data.size();
+    }
+    m_TextNodes[id] = storeMessageData(message.label, dir, data, dataLength, 0, printpc);
+}
+
+std::vector<size_t> Project::findSharedMessages(const std::vector<std::string> &files, const std::vector<EncodedFile> &encoded, std::vector<size_t> &sizes) const
+{
+    struct Candidate {
+        const std::string* group;
+        const std::vector<unsigned char>* data;
+        size_t index;
+        bool pinned;
+    };
+    // Text behind 2 byte pointers or kept within a bank is only shared inside its own table.
+    std::vector<std::string> groups(files.size());
+    std::vector<Candidate> candidates;
+    sizes.clear();
+    for (size_t file = 0; file < files.size(); file++) {
+        std::string dir = fs::path(files[file]).parent_path().filename().string();
+        auto table = m_TableList.find(dir);
+        if (table != m_TableList.end() && (table->second.getAddressSize() == 2 || table->second.getNoBankCross())) {
+            groups[file] = dir;
+        }
+        for (const EncodedMessage& message: encoded[file].messages) {
+            bool pinned = message.address != UNRESOLVED_ADDRESS || message.printpc;
+            candidates.push_back({&groups[file], &message.data, sizes.size(), pinned});
+            sizes.push_back(message.data.size());
+        }
+    }
+    // Sorted by reversed bytes, a message that ends another one comes right
+    // before it or before a message that also ends with it.
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        if (*a.group != *b.group) {
+            return *a.group < *b.group;
+        }
+        return std::lexicographical_compare(a.data->rbegin(), a.data->rend(), b.data->rbegin(), b.data->rend());
+    });
+    std::vector<size_t> hosts(sizes.size());
+    std::iota(hosts.begin(), hosts.end(), 0);
+    for (size_t i = candidates.size(); i > 1; i--) {
+        const Candidate& message = candidates[i - 2];
+        const Candidate& next = candidates[i - 1];
+        if (!message.pinned && *message.group == *next.group && message.data->size() <= next.data->size()
+                && std::equal(message.data->rbegin(), message.data->rend(), next.data->rbegin())) {
+            hosts[message.index] = hosts[next.index];
+        }
+    }
+    return hosts;
+}
+
+void Project::placeSharedMessages(const std::vector<SharedMessage> &shared, const std::vector<int> &labels, const std::vector<size_t> &sizes)
+{
+    std::vector<int> addresses(m_Labels.size(), UNRESOLVED_ADDRESS);
+    for (const AddressNode& node: m_Addresses) {
+        addresses[node.label] = node.address;
+    }
+    for (const SharedMessage& message: shared) {
+        int host = labels[message.host];
+        const TextNode& hostNode = m_TextNodes[host];
+        size_t offset = sizes[message.host] - sizes[message.message];
+        int address = addresses[host] + offset;
+        if (offset >= hostNode.size && hostNode.size < sizes[message.host]) {
+            // The host was split at a bank boundary and this tail lies past it.
+            address = addresses[m_LabelIds.at('$' + m_Labels[host])] + (offset - hostNode.size);
+        }
+        m_Addresses.push_back({address, message.label, false});
+        m_TextNodes[message.label] = {hostNode.files, sizes[message.message], false, hostNode.offset + offset, true};
+        m_MergedSize += sizes[message.message];
+    }
+}
+
+void Project::allocateMessages(std::vector<std::pair<std::string, EncodedMessage>> &messages)
+{
+    if (messages.empty()) {
+        return;
+    }
+    for (const AddressNode& node: m_Addresses) {
+        size_t size = node.isTable ? m_TableList.at(m_Labels[node.label]).getSize() : m_TextNodes[node.label].size;
+        m_FreeSpace.reserve(node.address, size);
+    }
+    // Largest first, so big messages are placed while the most space is left.
+    std::stable_sort(messages.begin(), messages.end(), [](const auto& a, const auto& b) {
+        return a.second.data.size() > b.second.data.size();
+    });
+    for (auto& [dir, message]: messages) {
+        const Table& table = m_TableList.at(dir);
+        // Two byte pointers can only reach the bank of their table.
+        bool shortPointers = table.getAddressSize() == 2;
+        int bank = shortPointers ? util::LoROMToPC(table.getAddress()) / FreeSpace::BANK_SIZE : FreeSpace::ANY_BANK;
+        int address = m_FreeSpace.allocate(message.data.size(), shortPointers || table.getNoBankCross(), bank);
+        if (address == -1) {
+            throw ParseError("Not enough free space left for message " + message.label
+                             + " (" + std::to_string(message.data.size()) + " bytes) in table " + dir + '.');
+        }
+        writeMessage(message, address, dir);
+    }
+}
+
+void Project::sortAddresses(std::vector<AddressNode> &nodes)
+{
+    // Stable LSD radix sort on the 24-bit SNES address, one byte per pass.
+    for (const AddressNode& node: nodes) {
+        if (node.address < 0 || node.address > 0xFFFFFF) {
+            std::stable_sort(nodes.begin(), nodes.end(), [](const AddressNode& a, const AddressNode& b) {
+                return a.address < b.address;
+            });
+            return;
+        }
+    }
+    std::vector<AddressNode> buffer(nodes.size());
+    for (int shift = 0; shift < 24; shift += 8) {
+        std::array<size_t, 257> offsets = {};
+        for (const AddressNode& node: nodes) {
+            offsets[((node.address >> shift) & 0xFF) + 1]++;
+        }
+        for (size_t i = 1; i < offsets.size(); i++) {
+            offsets[i] += offsets[i - 1];
+        }
+        for (const AddressNode& node: nodes) {
+            buffer[offsets[(node.address >> shift) & 0xFF]++] = node;
+        }
+        nodes.swap(buffer);
+    }
+}
+
+void Project::addLinkData(std::vector<LinkBlock> &blocks, int address, const char *data, size_t length)
+{
+    if (length == 0) {
+        return;
+    }
+    if (!blocks.empty() && blocks.back().address + blocks.back().data.size() == (size_t)address) {
+        blocks.back().data.append(data, length);
+    } else {
+        blocks.push_back({address, std::string(data, length)});
+    }
+}
+
+Project::TextNode Project::storeMessageData(const std::string &name, const std::string &dir, const std::vector<unsigned char> &data, size_t length, int start, bool printpc)
+{
+    if (m_PackedOutput || m_LinkOutput) {
+        std::string& blob = m_PackedData[dir];
+        size_t offset = blob.size();
+        blob.append((const char*)data.data() + start, length);
+        // Linked text is never written out, so the node names its blob instead.
+        return {m_LinkOutput ? dir : dir + ".bin", length, printpc, offset};
+    }
+    fs::path binFileName = fs::path(m_MainDir) / m_OutputDir / m_BinsDir / m_TextOutDir / (name + ".bin");
+    outputFile(binFileName.string(), data, length, start);
+    return {binFileName.filename().string(), length, printpc, 0};
+}
+
 void Project::outputFile(const std::string &file, const std::vector<unsigned char>& data, size_t length, int start)
 {
-    std::ofstream output(
-                file,
-                std::ios::binary | std::ios::out
-                );
-    if (!output) {
-        throw ASMError("Could not open " + file + " for writing");
+    outputFile(file, std::string((const char*)data.data() + start, length));
+}
+
+void Project::outputFile(const std::string &file, std::string data)
+{
+    std::string path = fs::absolute(file).string();
+    trace::Span span("outputFile", path);
+    if (m_WriteOutput) {
+        // Files a resident project wrote before are only rewritten if they changed.
+        uint64_t hash = util::hashData(data);
+        auto written = m_WrittenFiles.find(path);
+        if (written == m_WrittenFiles.end() || written->second != hash || !fs::exists(path)) {
+            std::ofstream output(
+                        file,
+                        std::ios::binary | std::ios::out
+                        );
+            if (!output) {
+                throw ASMError("Could not open " + file + " for writing");
+            }
+            output.write(data.data(), data.size());
+            output.close();
+            m_WrittenFiles[path] = hash;
+        }
     }
-    output.write((char*)&(data[start]), length);
-    output.close();
+    m_OutputFiles[path] = std::move(data);
 }
 
 bool Project::validateConfig(const YAML::Node &configYML)
 {
+    trace::Span span("validateConfig");
     std::ostringstream errorString;
     bool isValid = true;
     if (!configYML[FILES_SECTION].IsDefined() || !configYML[FILES_SECTION].IsMap()) {
@@ -542,6 +1506,21 @@ bool Project::validateConfig(const YAML::Node &configYML)
             errorString << "config > mapper must be a string.\n";
         }
     }
+    if (configYML[FREE_SPACE].IsDefined()) {
+        if (!configYML[FREE_SPACE].IsSequence()) {
+            isValid = false;
+            errorString << "freespace section in config must be a sequence.\n";
+        } else {
+            int regionIndex = 0;
+            for (auto node: configYML[FREE_SPACE]) {
+                if (!node["start"].IsScalar() || !node["end"].IsScalar()) {
+                    isValid = false;
+                    errorString << "freespace region at index " << regionIndex << " needs a start and an end address.\n";
+                }
+                regionIndex++;
+            }
+        }
+    }
     if (!configYML[ROMS].IsDefined()) {
         isValid = false;
         errorString << "roms section is missing.\n";
@@ -2,13 +2,19 @@
 #define PROJECT_H
 
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
+#include <memory>
 #include <string>
+#include <exception>
 #include <yaml-cpp/yaml.h>
 #include "parse.h"
 #include "font.h"
 #include "mapping.h"
 #include "table.h"
+#include "cache.h"
+#include "rompatcher.h"
+#include "freespace.h"
 
 namespace sable {
 
@@ -17,18 +23,40 @@ typedef std::vector<std::string> StringVector;
 class Project
 {
 public:
+    // What a changed file means for the next build in watch mode.
+    enum Change {NO_CHANGE, ASM_CHANGE, ROM_CHANGE, SCRIPT_CHANGE, CONFIG_CHANGE};
+    // Patches written next to each patched ROM, combined as flags.
+    enum PatchFormat {IPS_PATCH = 1, BPS_PATCH = 2};
     Project()=default;
     Project(const YAML::Node &config, const std::string &projectDir);
     Project(const std::string& projectDir);
     void init(const YAML::Node &config, const std::string &projectDir);
-    bool parseText();
+    bool parseText(Cache* cache = nullptr);
+    void setThreadCount(unsigned int threadCount);
+    void setWriteOutput(bool writeOutput);
+    void setPackedOutput(bool packedOutput);
+    void setLinkOutput(bool linkOutput);
+    void setMergeMessages(bool mergeMessages);
+    void setPatchFormats(unsigned int patchFormats);
+    void setSharedAssembly(bool sharedAssembly);
+    const MemoryFiles& getOutputFiles() const;
     void writePatchData();
+    void loadRoms();
+    std::vector<std::pair<std::string, bool>> getWatchDirectories() const;
+    Change classifyChange(const std::string& path) const;
+    std::vector<std::string> getConfigFiles() const;
+    EncodedFile encodeScript(std::string_view script) const;
     void writeFontData();
+    bool writeFontImage() const;
     std::string MainDir() const;
     std::string RomsDir() const;
     std::string FontConfig() const;
     std::string TextOutDir() const;
     int getMaxAddress() const;
+    size_t getScriptSize() const;
+    size_t getMessageCount() const;
+    size_t getMergedSize() const;
+    const std::vector<FreeSpace::Region>& getFreeSpace() const;
     explicit operator bool() const;
     int getWarningCount() const;
     StringVector::const_iterator getWarnings() const;
@@ -50,18 +78,29 @@ public:
     static constexpr const char* ROMS = "roms";
     static constexpr const char* DEFAULT_MODE = "defaultMode";
     static constexpr const char* MAP_TYPE = "mapper";
+    static constexpr const char* FREE_SPACE = "freespace";
 
 
 private:
     struct AddressNode {
         int address;
-        std::string label;
+        int label;
         bool isTable;
     };
     struct TextNode {
         std::string files;
-        size_t size;
-        bool printpc;
+        size_t size = 0;
+        bool printpc = false;
+        size_t offset = 0;
+        bool shared = false;
+    };
+    struct SharedMessage {
+        int label;
+        size_t message, host;
+    };
+    struct LinkBlock {
+        int address;
+        std::string data;
     };
     struct Rom {
         std::string file, name;
@@ -70,16 +109,58 @@ private:
     };
     friend YAML::convert<sable::Project::Rom>;
 
+    static constexpr const int UNRESOLVED_ADDRESS = -1;
     int nextAddress;
+    uint64_t m_InputHash = 0, m_FontHash = 0;
+    std::string m_FontImageFile;
+    size_t m_ScriptSize = 0, m_MessageCount = 0, m_MergedSize = 0;
+    unsigned int m_ThreadCount = 0;
+    bool m_WriteOutput = true;
+    bool m_PackedOutput = false;
+    bool m_LinkOutput = false;
+    bool m_MergeMessages = false;
+    bool m_SharedAssembly = true;
+    unsigned int m_PatchFormats = 0;
+    std::map<std::string, std::string> m_PackedData;
+    MemoryFiles m_OutputFiles;
+    std::unordered_map<std::string, uint64_t> m_WrittenFiles;
+    std::unordered_set<std::string> m_PatchedFiles;
+    std::vector<RomPatcher> m_BaseRoms;
+    std::string m_ProjectDir, m_FontFile;
+    std::vector<LinkBlock> m_TextBlocks, m_FontBlocks;
     std::string m_MainDir, m_InputDir, m_OutputDir, m_BinsDir, m_TextOutDir, m_RomsDir, m_FontDir;
     StringVector m_Includes, m_Extras, m_FontIncludes;
     std::vector<AddressNode> m_Addresses;
     std::vector<Rom> m_Roms;
     StringVector m_Warnings;
-    std::unordered_map<std::string, TextNode> m_TextNodeList;
+    std::vector<std::string> m_Labels;
+    std::unordered_map<std::string, int> m_LabelIds;
+    std::vector<TextNode> m_TextNodes;
     std::unordered_map<std::string, Table> m_TableList;
+    FreeSpace m_FreeSpace;
     TextParser m_Parser;
+    uint64_t buildDictionaries(const std::vector<std::string>& files);
+    EncodedFile encodeFile(const std::string &file, std::string_view script, int startAddress) const;
+    int internLabel(const std::string& label);
+    void writeMessage(const EncodedMessage &message, int &currentAddress, const std::string& dir);
+    std::vector<size_t> findSharedMessages(const std::vector<std::string>& files, const std::vector<EncodedFile>& encoded, std::vector<size_t>& sizes) const;
+    void placeSharedMessages(const std::vector<SharedMessage>& shared, const std::vector<int>& labels, const std::vector<size_t>& sizes);
+    void allocateMessages(std::vector<std::pair<std::string, EncodedMessage>>& messages);
+    static void sortAddresses(std::vector<AddressNode>& nodes);
+    static void addLinkData(std::vector<LinkBlock>& blocks, int address, const char* data, size_t length);
+    TextNode storeMessageData(const std::string& name, const std::string& dir, const std::vector<unsigned char>& data, size_t length, int start, bool printpc);
+    std::vector<std::string> patchRoms(const std::vector<size_t>& indices, const PatchResult* shared, const std::vector<bool>& useShared) const;
+    std::string outputRomFile(const Rom& romData) const;
+    std::unique_ptr<RomPatcher> loadRom(size_t index) const;
+    void prepareRom(RomPatcher& rom) const;
+    bool assembleSharedPatch(PatchResult& result) const;
+    std::vector<std::string> sharedIncludes() const;
+    std::string sharedPatchSource() const;
+    std::string romIncludeSource(const Rom& romData) const;
+    std::string sharedPatchFile() const;
+    std::string romIncludesFile(const Rom& romData) const;
     void outputFile(const std::string &file, const std::vector<unsigned char>& data, size_t length, int start = 0);
+    void outputFile(const std::string &file, std::string data);
     static bool validateConfig(const YAML::Node& configYML);
 };
 }
@@ -2,8 +2,20 @@
 #include "asar/asardll.h"
 #include <fstream>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 #include <sstream>
+#include <stdexcept>
 #include "wrapper/filesystem.h"
+#include "trace.h"
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 bool istringcompare(const std::string& a, const std::string& b) {
     if (a.length() != b.length()) {
@@ -42,13 +54,7 @@ sable::RomPatcher::RomPatcher(
     } else {
         m_Name = name;
     }
-    std::ifstream inFile(file, std::ios::in|std::ios::binary|std::ios_base::ate);
-    if (!inFile) {
-        throw std::runtime_error(fs::absolute(file).string() + " could not be opened.");
-    }
-    auto pos = inFile.tellg();
-    inFile.seekg(0, std::ios_base::beg);
-    auto size = pos - inFile.tellg();
+    auto size = fs::file_size(fs::path(file));
     if (header > 0) {
         m_HeaderSize = 512;
     } else if (header < 0) {
@@ -63,10 +69,10 @@ sable::RomPatcher::RomPatcher(
         throw std::runtime_error(file + " is too large.");
     }
     m_RomSize = size - m_HeaderSize;
-    m_data.resize(size);
-    inFile.read((char*)&m_data[0], size);
-
-    inFile.close();
+    m_data = RomBuffer(file);
+    if (m_data.size() != size) {
+        throw std::runtime_error(fs::absolute(file).string() + " could not be opened.");
+    }
 }
 
 bool sable::RomPatcher::expand(int address)
@@ -96,13 +102,14 @@ bool sable::RomPatcher::expand(int address)
     } else {
         m_RomSize = (1 + (address / 524288)) * 524288;
     }
-    m_data.resize(m_HeaderSize + m_RomSize, 0);
+    m_Changed.emplace_back(m_data.size(), m_HeaderSize + m_RomSize);
+    m_data.resize(m_HeaderSize + m_RomSize);
     if (m_RomSize > NORMAL_ROM_MAX_SIZE) {
-        auto internalHeader = m_data.begin()
+        auto internalHeader = m_data.data()
                 + util::ROMToPC(m_MapType, HEADER_LOCATION)
                 + m_HeaderSize;
         m_MapType = util::getExpandedType(m_MapType);
-        auto newHeader = m_data.begin()
+        auto newHeader = m_data.data()
                 + util::ROMToPC(m_MapType, HEADER_LOCATION)
                 + m_HeaderSize;
         std::copy(
@@ -110,23 +117,58 @@ bool sable::RomPatcher::expand(int address)
                     internalHeader + 0x20,
                     newHeader
                     );
+        m_Changed.emplace_back(newHeader - m_data.data(), newHeader - m_data.data() + 0x20);
     }
     return true;
 }
 
 bool sable::RomPatcher::applyPatchFile(const std::string &path, const std::string &format)
 {
-    std::vector<unsigned char> output(m_data);
-    if (!fs::exists(path)) {
+    return applyPatchFile(path, MemoryFiles(), format);
+}
+
+bool sable::RomPatcher::applyPatchFile(const std::string &path, const MemoryFiles &files, const std::string &format)
+{
+    std::string patchPath = fs::absolute(path).string();
+    if (files.find(patchPath) == files.end() && !fs::exists(path)) {
         throw std::logic_error("Could not open " + path + " patch file.");
     }
     if (format == "asm") {
         if (asar_init()) {
-            if (asar_patch(path.c_str(), (char*)&m_data[m_HeaderSize], m_RomSize, &m_RomSize)) {
+            std::vector<memoryfile> memoryFiles;
+            memoryFiles.reserve(files.size());
+            for (auto& file: files) {
+                memoryFiles.push_back({file.first.c_str(), file.second.data(), file.second.size()});
+            }
+            patchparams params = {};
+            params.structsize = (int)sizeof(patchparams);
+            params.patchloc = patchPath.c_str();
+            // Asar may grow the ROM into the rest of the buffer.
+            params.romdata = (char*)m_data.data() + m_HeaderSize;
+            params.buflen = RomBuffer::CAPACITY - m_HeaderSize;
+            params.romlen = &m_RomSize;
+            params.should_reset = true;
+            params.memory_files = memoryFiles.data();
+            params.memory_file_count = (int)memoryFiles.size();
+            trace::Span span("asar_patch", m_Name);
+            if (asar_patch_ex(&params)) {
                 m_AState = AsarState::Success;
+                int count;
+                const writtenblockdata* blocks = asar_getwrittenblocks(&count);
+                for (int i = 0; i < count; i++) {
+                    m_Changed.emplace_back(m_HeaderSize + blocks[i].pcoffset, m_HeaderSize + blocks[i].pcoffset + blocks[i].numbytes);
+                }
+                // Asar fixes the checksum without reporting it as written.
+                for (Mapper mapper: {Mapper::LOROM, m_MapType}) {
+                    int header = util::ROMToPC(mapper, HEADER_LOCATION);
+                    if (header != -1) {
+                        m_Changed.emplace_back(m_HeaderSize + header, m_HeaderSize + header + 0x40);
+                    }
+                }
             } else {
                 m_AState = AsarState::Error;
             }
+            m_data.resize(m_HeaderSize + m_RomSize);
         } else {
             return false;
         }
@@ -148,7 +190,10 @@ int sable::RomPatcher::getRealSize() const
 
 unsigned char &sable::RomPatcher::at(int n)
 {
-    return m_data.at(n);
+    if (n < 0 || (size_t)n >= m_data.size()) {
+        throw std::out_of_range("ROM offset out of range");
+    }
+    return m_data.data()[n];
 }
 
 unsigned char &sable::RomPatcher::atROMAddr(int n)
@@ -157,7 +202,80 @@ unsigned char &sable::RomPatcher::atROMAddr(int n)
     if (addr == -1) {
         throw std::logic_error("Invalid SNES Address");
     }
-    return m_data.at(addr + m_HeaderSize);
+    return at(addr + m_HeaderSize);
+}
+
+void sable::RomPatcher::writeData(int address, const char *data, size_t length)
+{
+    // Every supported mapping is contiguous within a 32 KiB window.
+    while (length > 0) {
+        size_t chunk = std::min<size_t>(length, 0x8000 - (address & 0x7FFF));
+        int addr = util::ROMToPC(m_MapType, address);
+        if (addr == -1) {
+            throw std::logic_error("Invalid SNES Address");
+        } else if (addr + chunk > (size_t)m_RomSize) {
+            std::ostringstream errorMsg;
+            errorMsg << "Error: data at $" << std::hex << address
+                     << " is past the end of " << m_Name << '.';
+            throw std::runtime_error(errorMsg.str());
+        }
+        std::copy(data, data + chunk, m_data.data() + m_HeaderSize + addr);
+        m_Changed.emplace_back(m_HeaderSize + addr, m_HeaderSize + addr + chunk);
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+sable::ByteRanges sable::RomPatcher::getChangedRanges() const
+{
+    return m_Changed;
+}
+
+sable::PatchResult sable::RomPatcher::getPatchResult() const
+{
+    PatchResult result;
+    if (m_AState != AsarState::Success) {
+        return result;
+    }
+    int count;
+    const writtenblockdata* blocks = asar_getwrittenblocks(&count);
+    for (int i = 0; i < count; i++) {
+        const char* start = (const char*)m_data.data() + m_HeaderSize + blocks[i].pcoffset;
+        result.blocks.emplace_back(blocks[i].pcoffset, std::string(start, blocks[i].numbytes));
+    }
+    const labeldata* labels = asar_getalllabels(&count);
+    for (int i = 0; i < count; i++) {
+        result.labels.emplace_back(labels[i].name, labels[i].location);
+    }
+    const char* const* prints = asar_getprints(&count);
+    result.prints.assign(prints, prints + count);
+    switch (asar_getmapper()) {
+    case lorom:
+        result.mapper = Mapper::LOROM;
+        break;
+    case exlorom:
+        result.mapper = Mapper::EXLOROM;
+        break;
+    default:
+        result.mapper = Mapper::INVALID;
+    }
+    return result;
+}
+
+bool sable::RomPatcher::writePatchResult(const PatchResult &result)
+{
+    for (auto& block: result.blocks) {
+        if (block.first < 0 || block.first + block.second.size() > (size_t)m_RomSize) {
+            return false;
+        }
+    }
+    for (auto& block: result.blocks) {
+        size_t offset = m_HeaderSize + block.first;
+        std::copy(block.second.begin(), block.second.end(), m_data.data() + offset);
+        m_Changed.emplace_back(offset, offset + block.second.size());
+    }
+    return true;
 }
 
 std::string sable::RomPatcher::getName() const
@@ -184,3 +302,174 @@ bool sable::RomPatcher::getMessages(std::back_insert_iterator<std::vector<std::s
     return true;
 
 }
+
+bool sable::RomPatcher::save(const std::string &path) const
+{
+    // Written next to the target and renamed over it, so nothing that still
+    // maps or reads the old file sees it half written.
+    std::string temporary = path + ".tmp";
+    bool written = false;
+#ifndef _WIN32
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd != -1) {
+        const unsigned char* data = m_data.data();
+        size_t length = m_data.size();
+        off_t offset = 0;
+        written = true;
+#ifdef MADV_POPULATE_READ
+        // Faulting the pages in at once is much faster than one at a time
+        // while the kernel copies them.
+        madvise(const_cast<unsigned char*>(data), length, MADV_POPULATE_READ);
+#endif
+        while (length > 0) {
+            ssize_t count = pwrite(fd, data + offset, length, offset);
+            if (count == 0 || (count < 0 && errno != EINTR)) {
+                written = false;
+                break;
+            } else if (count > 0) {
+                offset += count;
+                length -= count;
+            }
+        }
+        written &= close(fd) == 0;
+    }
+#else
+    std::ofstream output(temporary, std::ios::out | std::ios::binary);
+    output.write((const char*)m_data.data(), m_data.size());
+    output.close();
+    written = !output.fail();
+#endif
+    try {
+        if (written) {
+            fs::rename(temporary, path);
+            return true;
+        }
+        fs::remove(temporary);
+    } catch (std::runtime_error&) {
+        std::remove(temporary.c_str());
+    }
+    return false;
+}
+
+sable::RomBuffer::RomBuffer() : m_Data(nullptr), m_Size(0)
+{
+}
+
+sable::RomBuffer::RomBuffer(const std::string &file) : m_Data(nullptr), m_Size(0)
+{
+#ifndef _WIN32
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return;
+    }
+    allocate();
+    m_Size = std::min<size_t>(info.st_size, CAPACITY);
+    // The file is mapped over the start of the buffer. Pages are shared with
+    // the page cache until they are written to.
+    if (m_Size > 0 && mmap(m_Data, m_Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        size_t position = 0;
+        while (position < m_Size) {
+            ssize_t count = pread(fd, m_Data + position, m_Size - position, position);
+            if (count == 0 || (count < 0 && errno != EINTR)) {
+                break;
+            } else if (count > 0) {
+                position += count;
+            }
+        }
+        m_Size = position;
+    }
+    close(fd);
+#else
+    std::ifstream input(file, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!input) {
+        return;
+    }
+    size_t size = std::min<size_t>(input.tellg(), CAPACITY);
+    input.seekg(0, std::ios::beg);
+    allocate();
+    input.read((char*)m_Data, size);
+    m_Size = input.gcount();
+#endif
+}
+
+sable::RomBuffer::RomBuffer(const RomBuffer &other) : m_Data(nullptr), m_Size(other.m_Size)
+{
+    if (other.m_Data != nullptr) {
+        allocate();
+        std::memcpy(m_Data, other.m_Data, m_Size);
+    }
+}
+
+sable::RomBuffer::RomBuffer(RomBuffer &&other) noexcept : m_Data(other.m_Data), m_Size(other.m_Size)
+{
+    other.m_Data = nullptr;
+    other.m_Size = 0;
+}
+
+sable::RomBuffer &sable::RomBuffer::operator=(RomBuffer other) noexcept
+{
+    std::swap(m_Data, other.m_Data);
+    std::swap(m_Size, other.m_Size);
+    return *this;
+}
+
+sable::RomBuffer::~RomBuffer()
+{
+    if (m_Data != nullptr) {
+#ifndef _WIN32
+        munmap(m_Data, CAPACITY);
+#else
+        std::free(m_Data);
+#endif
+    }
+}
+
+unsigned char *sable::RomBuffer::data()
+{
+    return m_Data;
+}
+
+const unsigned char *sable::RomBuffer::data() const
+{
+    return m_Data;
+}
+
+size_t sable::RomBuffer::size() const
+{
+    return m_Size;
+}
+
+void sable::RomBuffer::resize(size_t size)
+{
+    if (size > CAPACITY) {
+        throw std::length_error("ROM buffer cannot hold " + std::to_string(size) + " bytes.");
+    } else if (m_Data == nullptr) {
+        allocate();
+    } else if (size < m_Size) {
+        // Keeps everything past the end zero for the next resize.
+        std::memset(m_Data + size, 0, m_Size - size);
+    }
+    m_Size = size;
+}
+
+void sable::RomBuffer::allocate()
+{
+    // Untouched pages of the buffer take no memory, and read as zero.
+#ifndef _WIN32
+    void* buffer = mmap(nullptr, CAPACITY, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+#else
+    void* buffer = std::calloc(CAPACITY, 1);
+    if (buffer == nullptr) {
+        throw std::bad_alloc();
+    }
+#endif
+    m_Data = static_cast<unsigned char*>(buffer);
+}
@@ -2,11 +2,52 @@
 #define ROMPATCHER_H
 #include "mapping.h"
 #include "util.h"
+#include "deltapatch.h"
 #include <vector>
 #include <string>
+#include <map>
 
 namespace sable {
 
+// Generated files handed to Asar without touching the disk, keyed by absolute path.
+typedef std::map<std::string, std::string> MemoryFiles;
+
+// Header and ROM data in one block that fits the largest ROM, so neither
+// expansion nor Asar has to move it. A ROM read from a file maps it
+// copy-on-write, so only the pages that change are copied. Bytes past
+// size() are always zero.
+class RomBuffer
+{
+public:
+    static constexpr const size_t CAPACITY = 512 + ROM_MAX_SIZE;
+
+    RomBuffer();
+    explicit RomBuffer(const std::string& file);
+    RomBuffer(const RomBuffer& other);
+    RomBuffer(RomBuffer&& other) noexcept;
+    RomBuffer& operator=(RomBuffer other) noexcept;
+    ~RomBuffer();
+    unsigned char* data();
+    const unsigned char* data() const;
+    size_t size() const;
+    void resize(size_t size);
+
+private:
+    unsigned char* m_Data;
+    size_t m_Size;
+    void allocate();
+};
+
+// What one patch wrote, labelled and printed, so the same result can be
+// given to another ROM without assembling it again. Blocks are ROM offsets
+// without the header and the bytes that ended up there.
+struct PatchResult {
+    std::vector<std::pair<int, std::string>> blocks;
+    std::vector<std::pair<std::string, int>> labels;
+    std::vector<std::string> prints;
+    Mapper mapper = Mapper::INVALID;
+};
+
 class RomPatcher
 {
 public:
@@ -14,15 +55,28 @@ public:
     //~RomPatcher();
     bool expand(int maxAddress);
     bool applyPatchFile(const std::string& path, const std::string& format = "asm");
+    bool applyPatchFile(const std::string& path, const MemoryFiles& files, const std::string& format = "asm");
     int getRomSize() const;
     int getRealSize() const;
     unsigned char& at(int n);
     unsigned char &atROMAddr(int n);
+    void writeData(int address, const char* data, size_t length);
     std::string getName() const;
     bool getMessages(std::back_insert_iterator<std::vector<std::string>> v);
+    bool save(const std::string& path) const;
+    // Only valid right after a successful applyPatchFile, as it reads what
+    // Asar kept from the last patch.
+    PatchResult getPatchResult() const;
+    // Writes the blocks of a result from another ROM. Returns false without
+    // writing anything if they do not fit in this one.
+    bool writePatchResult(const PatchResult& result);
+    // File offsets that may differ from the ROM this was read from: data
+    // written directly, the expanded area and what Asar reported writing.
+    ByteRanges getChangedRanges() const;
 
 private:
-    std::vector<unsigned char> m_data;
+    RomBuffer m_data;
+    ByteRanges m_Changed;
     std::string m_Name;
     int m_RomSize;
     int m_HeaderSize;
@@ -0,0 +1,322 @@
+#include "server.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "asar/asardll.h"
+#include "mappedfile.h"
+#include "util.h"
+#include "wrapper/filesystem.h"
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr uint32_t MAX_FRAME_SIZE = 64 << 20;
+
+void appendJsonStrings(std::string& out, std::vector<std::string>::const_iterator first, std::vector<std::string>::const_iterator last)
+{
+    out += '[';
+    for (auto it = first; it != last; ++it) {
+        if (it != first) {
+            out += ',';
+        }
+        sable::util::appendJsonString(out, *it);
+    }
+    out += ']';
+}
+
+bool getFlag(const YAML::Node& request, const char* name)
+{
+    return request[name].IsDefined() && request[name].as<bool>();
+}
+}
+
+namespace sable {
+
+#ifndef _WIN32
+BuildServer::BuildServer(const std::string &socketPath, int idleTimeout) :
+    m_SocketPath(socketPath), m_IdleTimeout(idleTimeout), m_Socket(-1), m_Running(true)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof (address.sun_path)) {
+        throw std::runtime_error("Socket path " + socketPath + " is too long.");
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof (address.sun_path) - 1);
+    m_Socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_Socket < 0) {
+        throw std::runtime_error(std::string("Could not create socket: ") + std::strerror(errno));
+    }
+    // A socket file left behind by a server that did not shut down cleanly
+    // would make bind fail. It is only removed if nothing answers on it, so
+    // a running server or a file that is not a socket is left alone.
+    struct stat info;
+    if (lstat(socketPath.c_str(), &info) == 0) {
+        bool stale = false;
+        if (S_ISSOCK(info.st_mode)) {
+            int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (probe >= 0) {
+                stale = connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof (address)) != 0
+                        && errno == ECONNREFUSED;
+                close(probe);
+            }
+        }
+        if (!stale) {
+            close(m_Socket);
+            throw std::runtime_error(socketPath + " is already in use.");
+        }
+        unlink(socketPath.c_str());
+    }
+    if (bind(m_Socket, reinterpret_cast<sockaddr*>(&address), sizeof (address)) != 0 || listen(m_Socket, 64) != 0) {
+        int error = errno;
+        close(m_Socket);
+        throw std::runtime_error("Could not listen on " + socketPath + ": " + std::strerror(error));
+    }
+    signal(SIGPIPE, SIG_IGN);
+    // Loaded once here, so patch workers forked later inherit it.
+    asar_init();
+}
+
+BuildServer::~BuildServer()
+{
+    if (m_Socket >= 0) {
+        close(m_Socket);
+        unlink(m_SocketPath.c_str());
+    }
+}
+
+void BuildServer::run()
+{
+    while (m_Running) {
+        pollfd listener = {m_Socket, POLLIN, 0};
+        int ready = poll(&listener, 1, m_IdleTimeout > 0 ? m_IdleTimeout * 1000 : -1);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        } else if (ready <= 0) {
+            break;
+        }
+        // Take every client that is already waiting. Requests are answered
+        // in order, and an identical build or parse request for the same
+        // project shares the answer of the first one.
+        std::vector<std::pair<int, std::string>> clients;
+        do {
+            int client = accept(m_Socket, nullptr, nullptr);
+            if (client < 0) {
+                break;
+            }
+            timeval timeout = {5, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+            std::string request;
+            if (readFrame(client, request)) {
+                clients.emplace_back(client, std::move(request));
+            } else {
+                close(client);
+            }
+            listener.revents = 0;
+        } while (poll(&listener, 1, 0) > 0);
+        std::map<std::string, std::string> answered;
+        for (auto& client: clients) {
+            auto previous = answered.find(client.second);
+            std::string response = previous != answered.end() ? previous->second : handleRequest(client.second);
+            answered.emplace(client.second, response);
+            writeFrame(client.first, response);
+            close(client.first);
+        }
+    }
+}
+
+bool BuildServer::readFrame(int fd, std::string &data)
+{
+    auto readAll = [fd](char* buffer, size_t length) {
+        while (length > 0) {
+            ssize_t count = read(fd, buffer, length);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            } else if (count <= 0) {
+                return false;
+            }
+            buffer += count;
+            length -= count;
+        }
+        return true;
+    };
+    unsigned char header[4];
+    if (!readAll(reinterpret_cast<char*>(header), sizeof (header))) {
+        return false;
+    }
+    uint32_t length = (uint32_t)header[0] << 24 | (uint32_t)header[1] << 16 | (uint32_t)header[2] << 8 | header[3];
+    if (length > MAX_FRAME_SIZE) {
+        return false;
+    }
+    data.resize(length);
+    return readAll(data.data(), length);
+}
+
+bool BuildServer::writeFrame(int fd, std::string_view data)
+{
+    std::string frame;
+    frame.reserve(data.size() + 4);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        frame += (char)(data.size() >> shift);
+    }
+    frame.append(data);
+    const char* buffer = frame.data();
+    size_t length = frame.size();
+    while (length > 0) {
+        ssize_t count = send(fd, buffer, length, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count <= 0) {
+            return false;
+        }
+        buffer += count;
+        length -= count;
+    }
+    return true;
+}
+
+std::string BuildServer::defaultSocketPath()
+{
+    const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir != nullptr && *runtimeDir != '\0') {
+        return (fs::path(runtimeDir) / "sable.sock").string();
+    }
+    return "/tmp/sable-" + std::to_string(getuid()) + ".sock";
+}
+#else
+BuildServer::BuildServer(const std::string &socketPath, int idleTimeout) :
+    m_SocketPath(socketPath), m_IdleTimeout(idleTimeout), m_Socket(-1), m_Running(false)
+{
+    throw std::runtime_error("The build server needs Unix domain sockets, which this platform does not provide.");
+}
+
+BuildServer::~BuildServer()
+{
+}
+
+void BuildServer::run()
+{
+}
+
+bool BuildServer::readFrame(int, std::string &)
+{
+    return false;
+}
+
+bool BuildServer::writeFrame(int, std::string_view)
+{
+    return false;
+}
+
+std::string BuildServer::defaultSocketPath()
+{
+    return "sable.sock";
+}
+#endif
+
+std::string BuildServer::handleRequest(std::string_view request)
+{
+    std::string response;
+    try {
+        YAML::Node node = YAML::Load(std::string(request));
+        if (!node.IsMap() || !node["command"].IsScalar()) {
+            throw std::runtime_error("Request must be an object with a \"command\".");
+        }
+        std::string command = node["command"].as<std::string>();
+        if (command == "shutdown") {
+            m_Running = false;
+            return "{\"ok\":true}";
+        } else if (command != "build" && command != "parse" && command != "encode") {
+            throw std::runtime_error("Unknown command \"" + command + "\".");
+        } else if (!node["project"].IsScalar()) {
+            throw std::runtime_error("Request must name a \"project\" directory.");
+        }
+        Resident& resident = findProject(node["project"].as<std::string>());
+        Project& project = *resident.project;
+        if (command == "encode") {
+            if (!node["text"].IsScalar()) {
+                throw std::runtime_error("Encode requests must have a \"text\" string.");
+            }
+            EncodedFile encoded = project.encodeScript(node["text"].as<std::string>());
+            if (encoded.error) {
+                std::rethrow_exception(encoded.error);
+            }
+            response = "{\"ok\":true,\"messages\":[";
+            for (size_t i = 0; i < encoded.messages.size(); i++) {
+                const EncodedMessage& message = encoded.messages[i];
+                response += i > 0 ? ",{\"label\":" : "{\"label\":";
+                util::appendJsonString(response, message.label);
+                response += ",\"data\":\"";
+                for (unsigned char byte: message.data) {
+                    static constexpr const char* hexDigits = "0123456789abcdef";
+                    response += hexDigits[byte >> 4];
+                    response += hexDigits[byte & 0xF];
+                }
+                response += "\"}";
+            }
+            response += "],\"warnings\":";
+            appendJsonStrings(response, encoded.warnings.begin(), encoded.warnings.end());
+            response += '}';
+            return response;
+        }
+        project.setWriteOutput(!getFlag(node, "inMemory"));
+        project.setPackedOutput(getFlag(node, "packed"));
+        project.setLinkOutput(getFlag(node, "link"));
+        project.setMergeMessages(getFlag(node, "merge"));
+        project.setSharedAssembly(!getFlag(node, "fullAssembly"));
+        project.setThreadCount(node["jobs"].IsDefined() ? node["jobs"].as<unsigned int>() : 0);
+        project.parseText(resident.cache.get());
+        resident.cache->setMaxAddress(project.getMaxAddress());
+        resident.cache->write();
+        if (command == "build") {
+            project.writePatchData();
+        }
+        response = "{\"ok\":true,\"messages\":" + std::to_string(project.getMessageCount())
+                + ",\"scriptSize\":" + std::to_string(project.getScriptSize())
+                + ",\"warnings\":";
+        appendJsonStrings(response, project.getWarnings(), project.getWarnings() + project.getWarningCount());
+        response += '}';
+    } catch (std::exception& e) {
+        response = "{\"ok\":false,\"error\":";
+        util::appendJsonString(response, e.what());
+        response += '}';
+    }
+    return response;
+}
+
+BuildServer::Resident &BuildServer::findProject(const std::string &dir)
+{
+    // A project stays loaded until its config or input mapping changes.
+    std::string key = fs::absolute(dir).lexically_normal().string();
+    auto found = m_Projects.find(key);
+    if (found != m_Projects.end() && found->second.configHash == hashConfig(found->second.project->getConfigFiles())) {
+        return found->second;
+    }
+    if (found != m_Projects.end()) {
+        m_Projects.erase(found);
+    }
+    Resident resident;
+    resident.project = std::make_unique<Project>(key);
+    resident.cache = std::make_unique<Cache>(key);
+    resident.configHash = hashConfig(resident.project->getConfigFiles());
+    return m_Projects[key] = std::move(resident);
+}
+
+uint64_t BuildServer::hashConfig(const std::vector<std::string> &files)
+{
+    uint64_t hash = util::hashData("");
+    for (const std::string& file: files) {
+        hash = util::hashData(MappedFile(file).data(), hash);
+    }
+    return hash;
+}
+}
@@ -0,0 +1,46 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "cache.h"
+#include "project.h"
+
+namespace sable {
+// Answers build requests from other tools over a local Unix domain socket,
+// so projects, fonts and Asar stay loaded between requests.
+// Each request and response is a 4-byte big-endian length followed by a
+// JSON object. Requests name a "command" (build, parse, encode or shutdown)
+// and, except for shutdown, a "project" directory.
+class BuildServer
+{
+public:
+    BuildServer(const std::string& socketPath, int idleTimeout);
+    ~BuildServer();
+    BuildServer(const BuildServer&) = delete;
+    BuildServer& operator=(const BuildServer&) = delete;
+    void run();
+    std::string handleRequest(std::string_view request);
+    static std::string defaultSocketPath();
+    static bool readFrame(int fd, std::string& data);
+    static bool writeFrame(int fd, std::string_view data);
+
+private:
+    struct Resident {
+        std::unique_ptr<Project> project;
+        std::unique_ptr<Cache> cache;
+        uint64_t configHash;
+    };
+    std::string m_SocketPath;
+    int m_IdleTimeout;
+    int m_Socket;
+    bool m_Running;
+    std::map<std::string, Resident> m_Projects;
+    Resident& findProject(const std::string& dir);
+    static uint64_t hashConfig(const std::vector<std::string>& files);
+};
+}
+
+#endif // SERVER_H
@@ -0,0 +1,144 @@
+#include "stats.h"
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "util.h"
+
+namespace {
+struct CounterInfo {
+    const char* description;
+    const char* jsonName;
+    const char* keyedJsonName;
+};
+
+constexpr CounterInfo COUNTER_INFO[sable::stats::COUNTER_COUNT] = {
+    {"Files opened", "filesOpened", nullptr},
+    {"Files from cache", "cachedFiles", nullptr},
+    {"Characters encoded", "characters", "charactersByFont"},
+    {"Digraph hits", "digraphs", "digraphsByFont"},
+    {"Bracket commands", "commands", nullptr},
+    {"Extras", "extras", nullptr},
+    {"@ directives", "directives", nullptr},
+    {"Messages", "messages", nullptr},
+    {"Bank splits", "bankSplits", nullptr},
+    {"Bytes written", "bytesWritten", "bytesWrittenByTable"},
+    {"Width warnings", "widthWarnings", nullptr},
+};
+
+struct Block {
+    std::mutex mutex;
+    sable::stats::Totals totals;
+};
+
+std::mutex registryMutex;
+std::vector<std::shared_ptr<Block>> blocks;
+
+// The block of a thread is only locked by that thread and by collect(),
+// so adding a count does not wait on other threads.
+Block& threadBlock()
+{
+    thread_local std::shared_ptr<Block> block;
+    if (!block) {
+        block = std::make_shared<Block>();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        blocks.push_back(block);
+    }
+    return *block;
+}
+}
+
+namespace sable {
+namespace stats {
+
+std::atomic<bool> counting(false);
+
+void start()
+{
+    counting = true;
+}
+
+void add(Counter counter, uint64_t amount)
+{
+    Block& block = threadBlock();
+    std::lock_guard<std::mutex> lock(block.mutex);
+    block.totals.values[counter] += amount;
+}
+
+void add(Counter counter, std::string_view key, uint64_t amount)
+{
+    Block& block = threadBlock();
+    std::lock_guard<std::mutex> lock(block.mutex);
+    block.totals.values[counter] += amount;
+    auto& byKey = block.totals.byKey[counter];
+    auto it = byKey.find(key);
+    if (it == byKey.end()) {
+        byKey.emplace(key, amount);
+    } else {
+        it->second += amount;
+    }
+}
+
+Totals collect()
+{
+    Totals totals;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& block: blocks) {
+        std::lock_guard<std::mutex> blockLock(block->mutex);
+        for (int counter = 0; counter < COUNTER_COUNT; counter++) {
+            totals.values[counter] += block->totals.values[counter];
+            for (auto& key: block->totals.byKey[counter]) {
+                totals.byKey[counter][key.first] += key.second;
+            }
+        }
+        block->totals = Totals();
+    }
+    return totals;
+}
+
+std::string formatTable(const Totals &totals)
+{
+    std::ostringstream table;
+    for (int counter = 0; counter < COUNTER_COUNT; counter++) {
+        table << std::left << std::setw(24) << COUNTER_INFO[counter].description
+              << std::right << std::setw(12) << totals.values[counter] << '\n';
+        for (auto& key: totals.byKey[counter]) {
+            table << "  " << std::left << std::setw(22) << key.first
+                  << std::right << std::setw(12) << key.second << '\n';
+        }
+    }
+    return table.str();
+}
+
+std::string formatJson(const Totals &totals)
+{
+    std::string json = "{";
+    for (int counter = 0; counter < COUNTER_COUNT; counter++) {
+        const CounterInfo& info = COUNTER_INFO[counter];
+        if (counter > 0) {
+            json += ',';
+        }
+        util::appendJsonString(json, info.jsonName);
+        json.append(":").append(std::to_string(totals.values[counter]));
+        if (info.keyedJsonName != nullptr) {
+            json += ',';
+            util::appendJsonString(json, info.keyedJsonName);
+            json += ":{";
+            bool first = true;
+            for (auto& key: totals.byKey[counter]) {
+                if (!first) {
+                    json += ',';
+                }
+                first = false;
+                util::appendJsonString(json, key.first);
+                json.append(":").append(std::to_string(key.second));
+            }
+            json += '}';
+        }
+    }
+    json += '}';
+    return json;
+}
+}
+}
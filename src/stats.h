@@ -0,0 +1,70 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace sable {
+namespace stats {
+// Counts the work a build does. Each thread adds to its own counters and
+// collect() sums them afterwards, so nothing is shared while parsing.
+// Nothing is counted until start() is called.
+enum Counter {
+    FILES_OPENED,
+    CACHED_FILES,
+    CHARACTERS,
+    DIGRAPHS,
+    COMMANDS,
+    EXTRAS,
+    DIRECTIVES,
+    MESSAGES,
+    BANK_SPLITS,
+    BYTES_WRITTEN,
+    WIDTH_WARNINGS,
+    COUNTER_COUNT
+};
+
+struct Totals {
+    std::array<uint64_t, COUNTER_COUNT> values = {};
+    // Counters added with a key, like characters per font or bytes per table.
+    std::array<std::map<std::string, uint64_t, std::less<>>, COUNTER_COUNT> byKey;
+};
+
+extern std::atomic<bool> counting;
+
+inline bool enabled()
+{
+    return counting.load(std::memory_order_relaxed);
+}
+void start();
+
+// Stops counting until it goes out of scope, for passes over the input
+// that the build repeats afterwards.
+class Pause
+{
+public:
+    Pause() : m_Counting(counting.exchange(false)) {}
+    ~Pause()
+    {
+        counting = m_Counting;
+    }
+    Pause(const Pause&) = delete;
+    Pause& operator=(const Pause&) = delete;
+
+private:
+    bool m_Counting;
+};
+void add(Counter counter, uint64_t amount = 1);
+void add(Counter counter, std::string_view key, uint64_t amount);
+// Sums the counters of every thread and sets them back to zero.
+Totals collect();
+std::string formatTable(const Totals& totals);
+std::string formatJson(const Totals& totals);
+}
+}
+
+#endif // STATS_H
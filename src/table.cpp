@@ -159,14 +159,18 @@ std::vector<std::string> Table::getDataFromFile(std::istream &tableFile)
                 }
             } else if (input == "data") {
                 if (lineStream >> option) {
-                    auto result = util::strToHex(option);
-                    if (result.second < 0 || util::LoROMToPC(result.first) == -1) {
-                        throw std::runtime_error(
-                                    "line " + std::to_string(tableLine) +
-                                    ": " + option + " is not a valid SNES address."
-                                    );
+                    if (option == "freespace") {
+                        setUseFreeSpace(true);
+                    } else {
+                        auto result = util::strToHex(option);
+                        if (result.second < 0 || util::LoROMToPC(result.first) == -1) {
+                            throw std::runtime_error(
+                                        "line " + std::to_string(tableLine) +
+                                        ": " + option + " is not a valid SNES address."
+                                        );
+                        }
+                        m_DataAddress = result.first;
                     }
-                    m_DataAddress = result.first;
                 } else {
                     throw std::runtime_error(
                                 "line " + std::to_string(tableLine) +
@@ -201,6 +205,8 @@ std::vector<std::string> Table::getDataFromFile(std::istream &tableFile)
                 // Probably should cause an error if widths aren't being stored.
                 // if (!lineStream.eof())
                 setStoreWidths(true);
+            } else if (input == "nobankcross") {
+                setNoBankCross(true);
             } else {
                 throw std::runtime_error(
                             "line " + std::to_string(tableLine)
@@ -256,6 +262,26 @@ void Table::setStoreWidths(bool StoreWidths)
     m_StoreWidths = StoreWidths;
 }
 
+bool Table::getUseFreeSpace() const
+{
+    return m_UseFreeSpace;
+}
+
+void Table::setUseFreeSpace(bool useFreeSpace)
+{
+    m_UseFreeSpace = useFreeSpace;
+}
+
+bool Table::getNoBankCross() const
+{
+    return m_NoBankCross;
+}
+
+void Table::setNoBankCross(bool noBankCross)
+{
+    m_NoBankCross = noBankCross;
+}
+
 bool operator!=(const Table::iterator &lsh, const Table::iterator &rhs)
 {
     return lsh.m_position != rhs.m_position;
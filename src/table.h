@@ -13,6 +13,10 @@ public:
     bool getStoreWidths() const;
     void setAddressSize(int addressSize);
     void setStoreWidths(bool storeWidths);
+    bool getUseFreeSpace() const;
+    void setUseFreeSpace(bool useFreeSpace);
+    bool getNoBankCross() const;
+    void setNoBankCross(bool noBankCross);
     void addEntry(int address, int size);
     void addEntry(const std::string& label);
     int getDataAddress() const;
@@ -46,6 +50,7 @@ private:
     std::vector<Entry> entries;
     int m_AddressSize, m_Address, m_DataAddress;
     bool m_StoreWidths;
+    bool m_UseFreeSpace = false, m_NoBankCross = false;
 };
 }
 
@@ -0,0 +1,142 @@
+#include "trace.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "util.h"
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace {
+struct Buffer {
+    std::mutex mutex;
+    std::string events;
+};
+
+std::mutex registryMutex;
+std::vector<std::shared_ptr<Buffer>> buffers;
+std::string collected;
+std::atomic<uint32_t> nextThreadId(1);
+int processId = 0;
+
+int64_t now()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Each thread appends to its own buffer, so recording never waits on other threads.
+Buffer& threadBuffer()
+{
+    thread_local std::shared_ptr<Buffer> buffer;
+    if (!buffer) {
+        buffer = std::make_shared<Buffer>();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+uint32_t threadId()
+{
+    thread_local uint32_t id = nextThreadId++;
+    return id;
+}
+
+#ifndef _WIN32
+// A forked worker starts with copies of the parent's spans, which the
+// parent writes itself.
+void clearAfterFork()
+{
+    processId = getpid();
+    collected.clear();
+    for (auto& buffer: buffers) {
+        buffer->events.clear();
+    }
+}
+#endif
+}
+
+namespace sable {
+namespace trace {
+
+std::atomic<bool> recording(false);
+
+void start()
+{
+#ifndef _WIN32
+    static std::once_flag registered;
+    std::call_once(registered, []() {
+        pthread_atfork(nullptr, nullptr, clearAfterFork);
+    });
+    processId = getpid();
+#endif
+    recording = true;
+}
+
+std::string takeEvents()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::string events = std::move(collected);
+    collected.clear();
+    for (auto& buffer: buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        events += buffer->events;
+        buffer->events.clear();
+    }
+    return events;
+}
+
+void addEvents(std::string_view events)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    collected.append(events.data(), events.size());
+}
+
+bool write(const std::string &path)
+{
+    // The spans stay recorded, so watch mode can rewrite the file after each build.
+    std::string events = takeEvents();
+    addEvents(events);
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        return false;
+    }
+    // Every event ends with a comma, so the last one is left out.
+    output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    output.write(events.data(), events.empty() ? 0 : events.size() - 1);
+    output << "]}\n";
+    return static_cast<bool>(output);
+}
+
+void Span::begin(const char *name, std::string_view detail)
+{
+    m_Name = name;
+    m_Detail.assign(detail.data(), detail.size());
+    m_Start = now();
+}
+
+void Span::end()
+{
+    int64_t duration = now() - m_Start;
+    std::string event = "{\"ph\":\"X\",\"cat\":\"sable\",\"name\":";
+    util::appendJsonString(event, m_Name);
+    event.append(",\"ts\":").append(std::to_string(m_Start))
+            .append(",\"dur\":").append(std::to_string(duration))
+            .append(",\"pid\":").append(std::to_string(processId))
+            .append(",\"tid\":").append(std::to_string(threadId()));
+    if (!m_Detail.empty()) {
+        event.append(",\"args\":{\"detail\":");
+        util::appendJsonString(event, m_Detail);
+        event += '}';
+    }
+    event.append("},");
+    Buffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events += event;
+}
+}
+}
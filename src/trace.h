@@ -0,0 +1,61 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace sable {
+namespace trace {
+// Records timed spans and writes them as Chrome trace-event JSON, which
+// chrome://tracing and Perfetto can open. Nothing is recorded until start()
+// is called, and a Span then costs one relaxed atomic load.
+extern std::atomic<bool> recording;
+
+inline bool enabled()
+{
+    return recording.load(std::memory_order_relaxed);
+}
+void start();
+bool write(const std::string& path);
+// Moves the spans recorded so far into a string that addEvents() accepts,
+// which lets forked workers send their spans back to the parent process.
+std::string takeEvents();
+void addEvents(std::string_view events);
+
+class Span
+{
+public:
+    explicit Span(const char* name, std::string_view detail = std::string_view()) : m_Name(nullptr)
+    {
+        if (enabled()) {
+            begin(name, detail);
+        }
+    }
+    ~Span()
+    {
+        finish();
+    }
+    // Ends the span before the end of its scope.
+    void finish()
+    {
+        if (m_Name != nullptr) {
+            end();
+            m_Name = nullptr;
+        }
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* m_Name;
+    std::string m_Detail;
+    int64_t m_Start;
+    void begin(const char* name, std::string_view detail);
+    void end();
+};
+}
+}
+
+#endif // TRACE_H
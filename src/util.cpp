@@ -2,8 +2,9 @@
 #include <sstream>
 #include <exception>
 #include <algorithm>
+#include <cctype>
 
-std::pair<unsigned int, int> sable::util::strToHex(const std::string &val)
+static std::pair<unsigned int, int> streamToHex(const std::string &val)
 {
     int bytes;
     std::stringstream t;
@@ -25,6 +26,40 @@ std::pair<unsigned int, int> sable::util::strToHex(const std::string &val)
     }
     return std::make_pair(tmp, bytes);
 }
+std::pair<unsigned int, int> sable::util::strToHex(std::string_view val)
+{
+    if (val.empty()) {
+        return std::make_pair(0, -1);
+    }
+    int bytes;
+    std::string_view digits = val;
+    if (val.front() == '$') {
+        bytes = val.length() / 2;
+        digits.remove_prefix(1);
+    } else {
+        bytes = (val.length() + 1) / 2;
+    }
+    unsigned int value = 0;
+    bool tooLarge = false;
+    size_t i = 0;
+    for (; i < digits.length() && std::isxdigit(static_cast<unsigned char>(digits[i])); i++) {
+        char c = digits[i];
+        value = (value << 4) | (std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : (std::tolower(c) - 'a' + 10));
+        tooLarge |= value > 0xFFFFFF;
+    }
+    // Signs, whitespace, "0x" prefixes and empty values keep the stream parsing rules.
+    if ((i == 0 && (digits.empty() || digits[0] == '+' || digits[0] == '-' || std::isspace(static_cast<unsigned char>(digits[0]))))
+            || (i == 1 && digits[0] == '0' && digits.length() > 1 && std::tolower(digits[1]) == 'x')) {
+        return streamToHex(std::string(val));
+    }
+    if (tooLarge) {
+        throw std::runtime_error(std::string("Hex value \"") + std::string(val) +"\" too large.");
+    }
+    if (i != digits.length()) {
+        return std::make_pair(0, -1);
+    }
+    return std::make_pair(value, bytes);
+}
 int sable::util::PCToLoROM(int addr, bool header, bool high)
 {
     if (header) {
@@ -150,3 +185,33 @@ size_t sable::util::calculateFileSize(const std::string &value)
     }
     return returnVal;
 }
+
+uint64_t sable::util::hashData(std::string_view data, uint64_t hash)
+{
+    // 64-bit FNV-1a, chained through the hash argument.
+    for (char c: data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+void sable::util::appendJsonString(std::string &out, std::string_view text)
+{
+    static constexpr const char* hexDigits = "0123456789abcdef";
+    out += '"';
+    for (char c: text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (byte < 0x20) {
+            out.append("\\u00").append(1, hexDigits[byte >> 4]).append(1, hexDigits[byte & 0xF]);
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
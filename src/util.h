@@ -1,7 +1,10 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "mapping.h"
 
@@ -11,7 +14,7 @@ namespace util {
 static constexpr size_t MAX_ALLOWED_FILESIZE = 8388608;
 
 typedef std::vector<unsigned char> ByteVector;
-std::pair<unsigned int, int> strToHex(const std::string& val);
+std::pair<unsigned int, int> strToHex(std::string_view val);
 int PCToLoROM(int addr, bool header = false, bool high = true);
 int PCToEXLoROM(int addr, bool header = false);
 int LoROMToPC(int addr, bool header = false);
@@ -20,6 +23,44 @@ int ROMToPC(Mapper mapType, int addr, bool header = false);
 int PCtoRom(Mapper mapType, int addr, bool header = false);
 size_t calculateFileSize(const std::string& value);
 Mapper getExpandedType(Mapper m);
+uint64_t hashData(std::string_view data, uint64_t hash = 0xcbf29ce484222325);
+void appendJsonString(std::string& out, std::string_view text);
+
+// Helpers for the binary cache and font image formats.
+template<class T>
+void writeValue(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof (T));
+}
+
+inline void writeString(std::string& out, std::string_view value)
+{
+    writeValue<uint32_t>(out, value.size());
+    out.append(value.data(), value.size());
+}
+
+template<class T>
+bool readValue(std::string_view& in, T& value)
+{
+    if (in.size() < sizeof (T)) {
+        return false;
+    }
+    std::memcpy(&value, in.data(), sizeof (T));
+    in.remove_prefix(sizeof (T));
+    return true;
+}
+
+template<class Container>
+bool readSequence(std::string_view& in, Container& value)
+{
+    uint32_t length;
+    if (!readValue(in, length) || in.size() < length) {
+        return false;
+    }
+    value.assign(in.data(), in.data() + length);
+    in.remove_prefix(length);
+    return true;
+}
 }
 
 }
@@ -0,0 +1,138 @@
+#include "workerpool.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+#ifndef _WIN32
+bool writeAll(int fd, const char* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+std::string readAll(int fd)
+{
+    std::string data;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof (buffer))) != 0) {
+        if (count > 0) {
+            data.append(buffer, count);
+        } else if (errno != EINTR) {
+            break;
+        }
+    }
+    return data;
+}
+#endif
+}
+
+std::vector<std::string> sable::runWorkers(size_t count, unsigned int workerCount, const WorkerTask &task)
+{
+    std::vector<std::string> results(count);
+    if (workerCount > count) {
+        workerCount = count;
+    }
+#ifndef _WIN32
+    if (workerCount > 1) {
+        std::vector<std::vector<size_t>> assigned(workerCount);
+        for (size_t i = 0; i < count; i++) {
+            assigned[i % workerCount].push_back(i);
+        }
+        struct Worker {
+            pid_t pid;
+            int fd;
+        };
+        std::vector<Worker> workers;
+        for (auto& indices: assigned) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                break;
+            }
+            pid_t pid = fork();
+            if (pid == 0) {
+                // Each result goes back as its index and length followed by the data.
+                close(fds[0]);
+                int status = 0;
+                try {
+                    std::vector<std::string> output = task(indices);
+                    for (size_t i = 0; i < indices.size() && i < output.size(); i++) {
+                        uint32_t header[2] = {(uint32_t)indices[i], (uint32_t)output[i].size()};
+                        if (!writeAll(fds[1], (const char*)header, sizeof (header))
+                                || !writeAll(fds[1], output[i].data(), output[i].size())) {
+                            status = 1;
+                            break;
+                        }
+                    }
+                } catch (...) {
+                    status = 1;
+                }
+                close(fds[1]);
+                _exit(status);
+            }
+            close(fds[1]);
+            if (pid < 0) {
+                close(fds[0]);
+                break;
+            }
+            workers.push_back({pid, fds[0]});
+        }
+        std::vector<bool> received(count, false);
+        for (auto& worker: workers) {
+            std::string data = readAll(worker.fd);
+            close(worker.fd);
+            waitpid(worker.pid, nullptr, 0);
+            size_t position = 0;
+            uint32_t header[2];
+            while (data.size() - position >= sizeof (header)) {
+                std::memcpy(header, data.data() + position, sizeof (header));
+                position += sizeof (header);
+                if (header[0] >= count || data.size() - position < header[1]) {
+                    break;
+                }
+                results[header[0]] = data.substr(position, header[1]);
+                received[header[0]] = true;
+                position += header[1];
+            }
+        }
+        // Anything a worker did not deliver, including the share of workers
+        // that could not be started, is run here instead.
+        std::vector<size_t> missing;
+        for (size_t i = 0; i < count; i++) {
+            if (!received[i]) {
+                missing.push_back(i);
+            }
+        }
+        if (!missing.empty()) {
+            std::vector<std::string> output = task(missing);
+            for (size_t i = 0; i < missing.size() && i < output.size(); i++) {
+                results[missing[i]] = std::move(output[i]);
+            }
+        }
+        return results;
+    }
+#endif
+    std::vector<size_t> indices(count);
+    for (size_t i = 0; i < count; i++) {
+        indices[i] = i;
+    }
+    std::vector<std::string> output = task(indices);
+    for (size_t i = 0; i < count && i < output.size(); i++) {
+        results[i] = std::move(output[i]);
+    }
+    return results;
+}
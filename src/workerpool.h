@@ -0,0 +1,18 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sable {
+// Splits the indices [0, count) between up to workerCount forked processes and
+// returns the result each process sent back for every index, in index order.
+// Asar keeps global state, so work that uses it cannot share one process.
+// Runs the work in the calling process if forking is unavailable or only one
+// worker is requested.
+typedef std::function<std::vector<std::string>(const std::vector<size_t>& indices)> WorkerTask;
+std::vector<std::string> runWorkers(size_t count, unsigned int workerCount, const WorkerTask& task);
+}
+
+#endif // WORKERPOOL_H
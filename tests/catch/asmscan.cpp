@@ -0,0 +1,48 @@
+#include <catch2/catch.hpp>
+#include "asmscan.h"
+#include "wrapper/filesystem.h"
+
+TEST_CASE("Scanning patches for dependencies", "[asmscan]")
+{
+    using namespace sable;
+    std::string dir = fs::absolute("scan").string();
+    MemoryFiles files;
+    auto scan = [&](const std::string& source) {
+        files[dir + "/main.asm"] = source;
+        return scanAsmDependencies(dir + "/main.asm", files);
+    };
+    SECTION("Plain code depends on nothing.")
+    {
+        REQUIRE(scan("!value = $10\nORG $808000\nmain:\n.loop\nLDA.w #!value : STA $7E0000\ndb \"freespace\"\n") == 0);
+    }
+    SECTION("Statements that read the ROM are found.")
+    {
+        REQUIRE(scan("freecode\nmain:\n") == READS_ROM);
+        REQUIRE(scan("db read1($808000)\n") == READS_ROM);
+        REQUIRE(scan("autoclean JSL hook\n") == READS_ROM);
+    }
+    SECTION("Defaults and checks for defines are found.")
+    {
+        REQUIRE(scan("!width ?= $849300\n") == CHECKS_DEFINES);
+        REQUIRE(scan("if defined(\"jp\")\nendif\n") == CHECKS_DEFINES);
+    }
+    SECTION("Settings only count as the first word of a statement.")
+    {
+        REQUIRE(scan("arch spc700\n") == SETS_STATE);
+        REQUIRE(scan("main: namespace menu\n") == SETS_STATE);
+        REQUIRE(scan("'A' = $80\n") == SETS_STATE);
+        REQUIRE(scan("db bank(main)\n!base = 1\nLDA !base\n") == 0);
+        REQUIRE(scan("; hirom\n") == 0);
+    }
+    SECTION("Included files are scanned relative to the file including them.")
+    {
+        files[dir + "/sub/a.asm"] = "incsrc \"b.asm\"\n";
+        files[dir + "/sub/b.asm"] = "incsrc a.asm\nprot data\n";
+        REQUIRE(scan("incsrc sub/a.asm\n") == READS_ROM);
+    }
+    SECTION("Includes that cannot be followed are reported.")
+    {
+        REQUIRE(scan("incsrc missing.asm\n") == UNKNOWN_SOURCE);
+        REQUIRE(scan("incsrc !dir/file.asm\n") == UNKNOWN_SOURCE);
+    }
+}
@@ -0,0 +1,86 @@
+#include <catch2/catch.hpp>
+#include <fstream>
+#include "wrapper/filesystem.h"
+#include "cache.h"
+
+TEST_CASE("Cache stores encoded files between runs", "[cache]")
+{
+    fs::path dir("cache_test");
+    fs::remove_all(dir);
+    fs::create_directory(dir);
+    sable::EncodedFile encoded;
+    encoded.messages.push_back({"label", -1, true, {0x01, 0x00, 0xFF}});
+    encoded.messages.push_back({"", 0x808000, false, {}});
+    encoded.warnings.push_back("a warning");
+    encoded.endAddress = 0x808010;
+    {
+        sable::Cache cache(dir.string());
+        REQUIRE_FALSE(cache.isReadable());
+        cache.setInputHash(1);
+        cache.storeFile("a.txt", 10, encoded);
+        cache.storeFile("b.txt", 20, encoded);
+        cache.setMaxAddress(0x808010);
+        REQUIRE(cache.write());
+    }
+    sable::Cache cache(dir.string());
+    REQUIRE(cache.isReadable());
+    REQUIRE(cache.getMaxAddress() == 0x808010);
+    SECTION("Unchanged files are found")
+    {
+        cache.setInputHash(1);
+        const sable::EncodedFile* found = cache.findFile("a.txt", 10);
+        REQUIRE(found != nullptr);
+        REQUIRE(found->messages.size() == 2);
+        REQUIRE(found->messages[0].label == "label");
+        REQUIRE(found->messages[0].address == -1);
+        REQUIRE(found->messages[0].printpc);
+        REQUIRE(found->messages[0].data == std::vector<unsigned char>{0x01, 0x00, 0xFF});
+        REQUIRE(found->messages[1].label.empty());
+        REQUIRE(found->messages[1].address == 0x808000);
+        REQUIRE(found->messages[1].data.empty());
+        REQUIRE(found->warnings == std::vector<std::string>{"a warning"});
+        REQUIRE(found->endAddress == 0x808010);
+    }
+    SECTION("Changed files are not found")
+    {
+        cache.setInputHash(1);
+        REQUIRE(cache.findFile("a.txt", 11) == nullptr);
+        REQUIRE(cache.findFile("c.txt", 10) == nullptr);
+    }
+    SECTION("Files no longer in the project are dropped")
+    {
+        cache.setInputHash(1);
+        cache.keepFiles({"b.txt"});
+        REQUIRE(cache.getFileCount() == 1);
+        REQUIRE(cache.findFile("a.txt", 10) == nullptr);
+    }
+    SECTION("A different input hash invalidates every file")
+    {
+        cache.setInputHash(2);
+        REQUIRE(cache.getFileCount() == 0);
+    }
+    SECTION("Files that failed to encode are not stored")
+    {
+        encoded.error = std::make_exception_ptr(std::runtime_error("error"));
+        cache.storeFile("a.txt", 10, encoded);
+        REQUIRE(cache.findFile("a.txt", 10) == nullptr);
+    }
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Cache reads the original format", "[cache]")
+{
+    fs::path dir("cache_test");
+    fs::remove_all(dir);
+    fs::create_directories(dir / "cache");
+    {
+        std::ofstream output((dir / "cache" / "cache.bin").string(), std::ios::binary);
+        int maxAddress = 0x818000;
+        output.write(reinterpret_cast<char*>(&maxAddress), sizeof (int));
+    }
+    sable::Cache cache(dir.string());
+    REQUIRE(cache.isReadable());
+    REQUIRE(cache.getMaxAddress() == 0x818000);
+    REQUIRE(cache.getFileCount() == 0);
+    fs::remove_all(dir);
+}
@@ -0,0 +1,132 @@
+#include <catch2/catch.hpp>
+#include <random>
+#include "deltapatch.h"
+
+namespace {
+std::string applyIps(std::string rom, std::string_view patch)
+{
+    REQUIRE(patch.substr(0, 5) == "PATCH");
+    size_t position = 5;
+    auto read = [&](int bytes) {
+        size_t value = 0;
+        while (bytes-- > 0) {
+            value = (value << 8) | (unsigned char)patch.at(position++);
+        }
+        return value;
+    };
+    while (patch.substr(position, 3) != "EOF") {
+        size_t offset = read(3), length = read(2);
+        std::string data;
+        if (length == 0) {
+            length = read(2);
+            data.assign(length, patch.at(position++));
+        } else {
+            data = std::string(patch.substr(position, length));
+            position += length;
+        }
+        if (rom.size() < offset + length) {
+            rom.resize(offset + length);
+        }
+        rom.replace(offset, length, data);
+    }
+    position += 3;
+    if (position < patch.size()) {
+        rom.resize(read(3));
+    }
+    return rom;
+}
+
+std::string applyBps(std::string_view source, std::string_view patch)
+{
+    REQUIRE(patch.substr(0, 4) == "BPS1");
+    size_t position = 4;
+    auto number = [&]() {
+        uint64_t value = 0, shift = 1;
+        while (true) {
+            unsigned char x = patch.at(position++);
+            value += (x & 0x7F) * shift;
+            if (x & 0x80) {
+                break;
+            }
+            shift <<= 7;
+            value += shift;
+        }
+        return value;
+    };
+    REQUIRE(number() == source.size());
+    std::string target(number(), '\0');
+    position += number();
+    size_t output = 0, sourceRelative = 0, targetRelative = 0;
+    while (position < patch.size() - 12) {
+        uint64_t data = number();
+        size_t length = (data >> 2) + 1;
+        switch (data & 3) {
+        case 0:
+            target.replace(output, length, source.substr(output, length));
+            break;
+        case 1:
+            target.replace(output, length, patch.substr(position, length));
+            position += length;
+            break;
+        default: {
+            uint64_t offset = number();
+            size_t& relative = (data & 3) == 2 ? sourceRelative : targetRelative;
+            relative += (offset & 1 ? -1 : 1) * (int64_t)(offset >> 1);
+            for (size_t i = 0; i < length; i++) {
+                target[output + i] = (data & 3) == 2 ? source[relative++] : target[relative++];
+            }
+        }
+        }
+        output += length;
+    }
+    REQUIRE(output == target.size());
+    REQUIRE(sable::crc32(patch.substr(0, patch.size() - 4)) == (uint32_t)((unsigned char)patch[patch.size() - 4]
+            | (unsigned char)patch[patch.size() - 3] << 8 | (unsigned char)patch[patch.size() - 2] << 16
+            | (uint32_t)(unsigned char)patch[patch.size() - 1] << 24));
+    return target;
+}
+}
+
+TEST_CASE("Delta patches", "[deltapatch]")
+{
+    std::mt19937 random(42);
+    std::string source(0x80000, '\0');
+    for (char& c: source) {
+        c = (char)random();
+    }
+    SECTION("CRC32 matches the standard check value in any number of pieces.")
+    {
+        REQUIRE(sable::crc32("123456789") == 0xCBF43926);
+        uint32_t pieces = 0;
+        for (size_t i = 0; i < source.size(); i += 7) {
+            pieces = sable::crc32(std::string_view(source).substr(i, 7), pieces);
+        }
+        REQUIRE(sable::crc32(source) == pieces);
+    }
+    SECTION("Changed and expanded ROMs are rebuilt from the patches.")
+    {
+        std::string target = source;
+        target.resize(0x454F50 + 0x40000, '\0');
+        sable::ByteRanges changed = {{0x10, 0x20}, {0x1000, 0x13000}, {0x7FC0, 0x8000}, {0x454F46, 0x454F48}};
+        for (size_t i = 0x1000; i < 0x3000; i++) {
+            target[i] = (char)random();
+        }
+        std::fill(target.begin() + 0x3000, target.begin() + 0x12000, '\x55');
+        target[0x12345] = 1;
+        target[0x7FDC] = 2;
+        target[0x454F46] = 3;
+        target[0x454F47] = 4;
+        target[target.size() - 1] = 5;
+        std::string ips = sable::makeIpsPatch(source, target, changed);
+        std::string bps = sable::makeBpsPatch(source, target, changed);
+        REQUIRE(applyIps(source, ips) == target);
+        REQUIRE(applyBps(source, bps) == target);
+        REQUIRE(ips.size() < 0x3000);
+        REQUIRE(bps.size() < 0x3000);
+    }
+    SECTION("A ROM that did not change gives an empty patch.")
+    {
+        REQUIRE(sable::makeIpsPatch(source, source, {{0, 0x100}}) == "PATCHEOF");
+        REQUIRE(applyBps(source, sable::makeBpsPatch(source, source, {{0, 0x100}})) == source);
+    }
+}
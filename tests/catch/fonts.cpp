@@ -1,6 +1,7 @@
 #include <catch2/catch.hpp>
 #include <vector>
 #include "font.h"
+#include "dictionary.h"
 
 YAML::Node createSampleNode(
         bool digraphs,
@@ -179,6 +180,73 @@ TEST_CASE("Test 1-byte fonts.")
 //        REQUIRE(std::get<0>(result) == normalNode[Font::ENCODING]["l"][Font::CODE_VAL].as<int>());
 //        REQUIRE(!std::get<1>(result));
     }
+    SECTION("Test longest match encoding")
+    {
+        normalNode[Font::ENCODING]["am"][Font::CODE_VAL] = 120;
+        normalNode[Font::ENCODING]["am"][Font::TEXT_LENGTH_VAL] = 9;
+        normalNode[Font::ENCODING]["ama"][Font::CODE_VAL] = 121;
+        Font f(normalNode, "normal");
+        std::string text = "llama❤";
+        unsigned int code;
+        int width;
+        size_t length;
+        std::tie(code, width, length) = f.matchText(text.data(), text.data() + text.size());
+        REQUIRE(code == std::get<0>(f.getTextCode("l", "l")));
+        REQUIRE(length == 2);
+        // Names longer than a digraph are only reachable in brackets.
+        std::tie(code, width, length) = f.matchText(text.data() + 2, text.data() + text.size());
+        REQUIRE(code == 120);
+        REQUIRE(width == 9);
+        REQUIRE(length == 2);
+        std::tie(code, width, length) = f.matchText(text.data() + 3, text.data() + text.size());
+        REQUIRE(code == std::get<0>(f.getTextCode("m")));
+        REQUIRE(width == f.getWidth("m"));
+        REQUIRE(length == 1);
+        std::tie(code, width, length) = f.matchText(text.data() + 5, text.data() + text.size());
+        REQUIRE(code == std::get<0>(f.getTextCode("❤")));
+        REQUIRE(length == text.size() - 5);
+        std::string missing = "@";
+        REQUIRE_THROWS(f.matchText(missing.data(), missing.data() + missing.size()));
+        normalNode[Font::USE_DIGRAPHS] = "false";
+        Font noDigraphs(normalNode, "noDigraphs");
+        std::tie(code, width, length) = noDigraphs.matchText(text.data(), text.data() + text.size());
+        REQUIRE(code == std::get<0>(f.getTextCode("l")));
+        REQUIRE(length == 1);
+    }
+    SECTION("Test run encoding matches longest match encoding")
+    {
+        Font f(normalNode, "normal");
+        std::string text = "ABCDFGHJKMNOPQRSTUVWXY abcdfghjkmnopqrstuvwxy Some TEXT that goes on for more than one block, Quite A Bit More (\"04\") ❤ before ending";
+        std::vector<unsigned char> expected, encoded;
+        int expectedWidth = 0, encodedWidth = 0;
+        for (const char* it = text.data(); it != text.data() + text.size();) {
+            unsigned int code;
+            int width;
+            size_t length;
+            std::tie(code, width, length) = f.matchText(it, text.data() + text.size());
+            expected.push_back(code);
+            expectedWidth += width;
+            it += length;
+        }
+        for (const char* it = text.data(); it != text.data() + text.size();) {
+            int width;
+            size_t length = f.encodeRun(it, text.data() + text.size(), width, std::back_inserter(encoded));
+            if (length == 0) {
+                unsigned int code;
+                std::tie(code, width, length) = f.matchText(it, text.data() + text.size());
+                encoded.push_back(code);
+            }
+            encodedWidth += width;
+            it += length;
+        }
+        REQUIRE(encoded == expected);
+        REQUIRE(encodedWidth == expectedWidth);
+        int width;
+        std::string reserved = "#[@";
+        for (size_t i = 0; i < reserved.size(); i++) {
+            REQUIRE(f.encodeRun(reserved.data() + i, reserved.data() + reserved.size(), width, std::back_inserter(encoded)) == 0);
+        }
+    }
     SECTION("Test font with extras.")
     {
         normalNode[Font::EXTRAS]["SomeExtra"] = 1;
@@ -186,6 +254,94 @@ TEST_CASE("Test 1-byte fonts.")
         REQUIRE(f.getExtraValue("SomeExtra") == 1);
         REQUIRE_THROWS(f.getExtraValue("SomeMissingExtra"));
     }
+    SECTION("Bracket names resolve through the symbol table.")
+    {
+        normalNode[Font::EXTRAS]["SomeExtra"] = 1;
+        Font f(normalNode, "normal");
+        const Font::Symbol* symbol = f.findSymbol("NewLine");
+        REQUIRE(symbol != nullptr);
+        REQUIRE(symbol->type == Font::COMMAND);
+        REQUIRE(symbol->code == f.getCommandCode("NewLine"));
+        REQUIRE(symbol->isNewLine);
+        symbol = f.findSymbol("A");
+        REQUIRE(symbol != nullptr);
+        REQUIRE(symbol->type == Font::TEXT);
+        REQUIRE(symbol->code == std::get<0>(f.getTextCode("A")));
+        REQUIRE(symbol->width == f.getWidth("A"));
+        symbol = f.findSymbol("SomeExtra");
+        REQUIRE(symbol != nullptr);
+        REQUIRE(symbol->type == Font::EXTRA);
+        REQUIRE(symbol->code == 1);
+        REQUIRE(f.findSymbol("SomeMissingExtra") == nullptr);
+    }
+    SECTION("Dictionary entries replace frequent runs.")
+    {
+        normalNode[Font::DICTIONARY][Font::DICT_ADDR_VAL] = "$C80000";
+        normalNode[Font::DICTIONARY][Font::DICT_CODES_VAL] = YAML::Load("[0x50, 0x9F]");
+        normalNode[Font::DICTIONARY][Font::DICT_LENGTH_VAL] = 3;
+        Font f(normalNode, "normal");
+        std::vector<unsigned int> codes = f.getDictionaryCodes();
+        REQUIRE(codes.front() == 0x53);
+        REQUIRE(codes.back() == 0x9F);
+        std::vector<sable::Font::DictionaryEntry> dictionary = sable::buildDictionary(f, {"the theme", "then the", "other"}, 2);
+        REQUIRE(!dictionary.empty());
+        std::vector<sable::Font::DictionaryEntry> serial = sable::buildDictionary(f, {"the theme", "then the", "other"}, 1);
+        REQUIRE(serial.size() == dictionary.size());
+        for (size_t i = 0; i < serial.size(); i++) {
+            REQUIRE(serial[i].code == dictionary[i].code);
+            REQUIRE(serial[i].text == dictionary[i].text);
+        }
+        auto the = std::find_if(dictionary.begin(), dictionary.end(), [](const Font::DictionaryEntry& entry) {
+            return entry.text == "the";
+        });
+        REQUIRE(the != dictionary.end());
+        REQUIRE(the->glyphs.size() == 3);
+        REQUIRE(the->width == f.getWidth("t") + f.getWidth("h") + f.getWidth("e"));
+        f.setDictionary(dictionary);
+        std::string text = "theme";
+        unsigned int code;
+        int width;
+        size_t length;
+        std::tie(code, width, length) = f.matchText(text.data(), text.data() + text.size());
+        REQUIRE(code == the->code);
+        REQUIRE(width == the->width);
+        REQUIRE(length == 3);
+        std::string table = f.getDictionaryTable();
+        size_t slot = (the->code - 0x50) * 4;
+        REQUIRE(table.size() >= slot + 4);
+        REQUIRE(table[slot] == 3);
+        REQUIRE(static_cast<unsigned char>(table[slot + 1]) == std::get<0>(f.getTextCode("t")));
+    }
+}
+
+TEST_CASE("Bracketed encoding names are not matched in plain text.")
+{
+    using sable::Font;
+    YAML::Node map = YAML::LoadFile("sample/text_map.yml");
+    Font f(map["normal"], "normal");
+    for (std::string text: {"Bullet", "Space2 here"}) {
+        // What looking up each character and the one after it gives.
+        std::vector<unsigned int> expected, encoded;
+        for (size_t i = 0; i < text.size();) {
+            unsigned int code;
+            bool isDigraph;
+            std::tie(code, isDigraph) = f.getTextCode(text.substr(i, 1), text.substr(i + 1, 1));
+            expected.push_back(code);
+            i += isDigraph ? 2 : 1;
+        }
+        for (const char* it = text.data(); it != text.data() + text.size();) {
+            unsigned int code;
+            int width;
+            size_t length;
+            std::tie(code, width, length) = f.matchText(it, text.data() + text.size());
+            encoded.push_back(code);
+            it += length;
+        }
+        REQUIRE(encoded == expected);
+        REQUIRE(encoded.front() == std::get<0>(f.getTextCode(text.substr(0, 1))));
+    }
+    REQUIRE(f.findSymbol("Bullet")->code == 0xf9);
+    REQUIRE(f.findSymbol("Space2")->code == 0xc4);
 }
 
 TEST_CASE("Test 2-byte fonts.")
@@ -294,4 +450,16 @@ TEST_CASE("Test config validation")
         normalNode[Font::EXTRAS] = "1";
         REQUIRE_THROWS_WITH(Font(normalNode, ""), Contains("must be a map."));
     }
+    SECTION("Check Dictionary validation.")
+    {
+        normalNode[Font::DICTIONARY][Font::DICT_ADDR_VAL] = "$C80000";
+        REQUIRE_THROWS_WITH(Font(normalNode, ""), Contains(std::string("Required field \"") + Font::DICT_CODES_VAL + "\" is missing."));
+        normalNode[Font::DICTIONARY][Font::DICT_CODES_VAL] = YAML::Load("[0x90, 0x80]");
+        REQUIRE_THROWS_WITH(Font(normalNode, ""), Contains("must be a first and last code"));
+        normalNode[Font::DICTIONARY][Font::DICT_CODES_VAL] = YAML::Load("[0x80, 0x90]");
+        normalNode[Font::DICTIONARY][Font::DICT_LENGTH_VAL] = 1;
+        REQUIRE_THROWS_WITH(Font(normalNode, ""), Contains("must be between 2 and 255."));
+        normalNode[Font::DICTIONARY] = "1";
+        REQUIRE_THROWS_WITH(Font(normalNode, ""), Contains("must be a map."));
+    }
 }
@@ -0,0 +1,58 @@
+#include <catch2/catch.hpp>
+#include "freespace.h"
+#include "util.h"
+
+TEST_CASE("Free space allocation", "[freespace]")
+{
+    sable::FreeSpace space;
+    REQUIRE(space.empty());
+    space.addRegion(0xC08000, 0xC0FFFF);
+    space.addRegion(0xC18000, 0xC180FF);
+    REQUIRE(!space.empty());
+    SECTION("Invalid and overlapping regions are rejected.")
+    {
+        REQUIRE_THROWS(space.addRegion(0x7E0000, 0x7E1000));
+        REQUIRE_THROWS(space.addRegion(0xC0FFFF, 0xC08000));
+        REQUIRE_THROWS(space.addRegion(0xC0F000, 0xC18000));
+    }
+    SECTION("The smallest range that fits is used first.")
+    {
+        REQUIRE(space.allocate(0x80, false) == 0xC18000);
+        REQUIRE(space.allocate(0x80, false) == 0xC18080);
+        REQUIRE(space.allocate(0x80, false) == 0xC08000);
+        REQUIRE(space.getRegions()[0].used == 0x80);
+        REQUIRE(space.getRegions()[1].used == 0x100);
+    }
+    SECTION("Reserved space is not handed out.")
+    {
+        space.reserve(0xC08000, 0x10);
+        space.reserve(0xC18000, 0x100);
+        REQUIRE(space.allocate(0x10, false) == 0xC08010);
+        REQUIRE(space.getRegions()[0].used == 0x20);
+    }
+    SECTION("Resetting frees all space again.")
+    {
+        REQUIRE(space.allocate(0x100, false) == 0xC18000);
+        space.reserve(0xC08000, 0x10);
+        space.reset();
+        REQUIRE(space.getRegions()[0].used == 0);
+        REQUIRE(space.getRegions()[1].used == 0);
+        REQUIRE(space.allocate(0x100, false) == 0xC18000);
+        REQUIRE(space.allocate(0x10, false) == 0xC08000);
+    }
+    SECTION("Data that does not fit is refused.")
+    {
+        REQUIRE(space.allocate(0x8001, false) == -1);
+        REQUIRE(space.allocate(0x8000, false) == 0xC08000);
+        REQUIRE(space.allocate(0x101, false) == -1);
+    }
+    SECTION("Data can be kept inside one bank.")
+    {
+        sable::FreeSpace banks;
+        banks.addRegion(0xC0FF00, 0xC1FFFF);
+        REQUIRE(banks.allocate(0x80, true) == 0xC0FF00);
+        REQUIRE(banks.allocate(0x100, true) == 0xC18000);
+        REQUIRE(banks.allocate(0x10, false, sable::util::LoROMToPC(0xC08000) / sable::FreeSpace::BANK_SIZE) == 0xC0FF80);
+        REQUIRE(banks.allocate(0x80, true, sable::util::LoROMToPC(0xC08000) / sable::FreeSpace::BANK_SIZE) == -1);
+    }
+}
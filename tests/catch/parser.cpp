@@ -1,10 +1,34 @@
 #include <catch2/catch.hpp>
 #include <sstream>
 #include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include "parse.h"
 
 typedef std::vector<unsigned char> ByteVector;
 
+static std::atomic<size_t> allocationCount(0);
+
+void* operator new(std::size_t size)
+{
+    allocationCount++;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
 YAML::Node getSampleNode()
 {
     static YAML::Node sampleNode = YAML::LoadFile("sample/text_map.yml");
@@ -83,3 +107,107 @@ TEST_CASE("Parse Several Lines With Settings", "[parser]")
     REQUIRE(v.back() == 0);
     REQUIRE(v.size() == 102);
 }
+
+TEST_CASE("Parsing lines does not allocate per character or token", "[parser]")
+{
+    sable::TextParser p(getSampleNode(), "normal");
+    const std::string block =
+            "@label dialogue_07\n"
+            "@width 160\n"
+            "[SetColor][04]If you're wounded, you can \n"
+            "rest in the forts, where you'll \n"
+            "slowly recover vitality. [AddSpaces][03]\n"
+            "# comment line\n"
+            "[End]\n";
+    std::string script;
+    while (script.size() < 1024 * 1024) {
+        script += block;
+    }
+    std::vector<std::string_view> lines;
+    for (size_t start = 0; start < script.size();) {
+        size_t end = script.find('\n', start);
+        lines.emplace_back(script.data() + start, end - start);
+        start = end + 1;
+    }
+    ByteVector v;
+    v.reserve(script.size());
+    auto settings = p.getDefaultSetting(0x808000);
+    size_t messages = 0;
+    size_t before = allocationCount;
+    for (size_t i = 0; i < lines.size(); i++) {
+        int next = (i + 1 < lines.size())
+                ? (lines[i + 1].empty() ? '\n' : lines[i + 1].front())
+                : std::char_traits<char>::eof();
+        if (p.parseLine(lines[i], next, settings, std::back_inserter(v)).first) {
+            messages++;
+            settings.label.clear();
+        }
+    }
+    size_t allocations = allocationCount - before;
+    REQUIRE(messages > 1000);
+    REQUIRE(v.size() > script.size() / 2);
+    REQUIRE(allocations < 16);
+}
+
+TEST_CASE("Parsing a buffer matches parsing a stream", "[parser]")
+{
+    sable::TextParser p(getSampleNode(), "nodigraph");
+    std::string script = "@address $e0e9b0\r\n"
+                         "@width 160\n"
+                         "[SetColor][04]If you're wounded, you can \n"
+                         "rest in the forts, where you'll \r\n"
+                         "#comment\n"
+                         "slowly recover vitality.[End]\n"
+                         "\n"
+                         "@label second\n"
+                         "Another message";
+    std::vector<std::tuple<bool, int, ByteVector>> expected, actual;
+    {
+        std::istringstream input(script);
+        auto settings = p.getDefaultSetting(0);
+        ByteVector v;
+        while (input) {
+            auto result = p.parseLine(input, settings, std::back_inserter(v));
+            if (input || result.second != 0 || !v.empty()) {
+                expected.emplace_back(result.first, result.second, v);
+            }
+            if (result.first) {
+                v.clear();
+            }
+        }
+    }
+    auto settings = p.getDefaultSetting(0);
+    ByteVector v;
+    int lines = 0;
+    p.parseBuffer(script, settings, std::back_inserter(v), [&](bool done, int length, int line) {
+        REQUIRE(line == ++lines);
+        actual.emplace_back(done, length, v);
+        if (done) {
+            v.clear();
+        }
+    });
+    REQUIRE(lines == 9);
+    REQUIRE(actual == expected);
+    REQUIRE(settings.label == "second");
+}
+
+TEST_CASE("A font image parses the same as the mapping it was built from", "[parser]")
+{
+    sable::TextParser p(getSampleNode(), "normal");
+    std::string image = p.getFontImage(42);
+    sable::TextParser loaded("normal");
+    REQUIRE_FALSE(loaded.readFontImage(image, 43));
+    REQUIRE_FALSE(loaded.readFontImage(image.substr(0, image.size() - 1), 42));
+    REQUIRE(loaded.readFontImage(image, 42));
+    REQUIRE(loaded.getFonts().size() == p.getFonts().size());
+    std::string script = "[NewLine]This is a test.\n"
+                         "@type menu\n"
+                         "Menu text[End]\n";
+    ByteVector expected, actual;
+    auto expectedSettings = p.getDefaultSetting(0x808000);
+    p.parseBuffer(script, expectedSettings, std::back_inserter(expected), [](bool, int, int) {});
+    auto actualSettings = loaded.getDefaultSetting(0x808000);
+    loaded.parseBuffer(script, actualSettings, std::back_inserter(actual), [](bool, int, int) {});
+    REQUIRE(actual == expected);
+    REQUIRE(loaded.getFontImage(42) == image);
+}
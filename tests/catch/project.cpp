@@ -1,7 +1,13 @@
 #include <catch2/catch.hpp>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
 #include "wrapper/filesystem.h"
 #include "yaml-cpp/yaml.h"
 #include "project.h"
+#include "exceptions.h"
+#include "trace.h"
 
 using sable::Project;
 
@@ -59,3 +65,354 @@ TEST_CASE("Test project config validation", "[project]")
         REQUIRE_NOTHROW(Project(testNode, "."));
     }
 }
+
+TEST_CASE("Changed files are classified for watch mode", "[project]")
+{
+    YAML::Node testNode = YAML::Load(
+                "{\n"
+                "files: {\n"
+                    "mainDir: sample,\n"
+                    "input: {directory: text},\n"
+                    "output: {\n"
+                        "directory: asm, includes: [code.asm],\n"
+                        "binaries: {\n"
+                            "mainDir: bin, textDir: text,\n"
+                            "fonts: {dir: fonts, includes: [] }\n"
+                        "}\n"
+                    "},\n"
+                    "romDir: roms\n"
+                "}"
+                ", config: \n"
+                    "{directory: sample, inMapping: text_map.yml},\n"
+                "roms: [{name: test, file: test.smc, header: false}]"
+                "}"
+                );
+    Project project(testNode, ".");
+    REQUIRE(project.classifyChange("config.yml") == Project::CONFIG_CHANGE);
+    REQUIRE(project.classifyChange("sample/text_map.yml") == Project::CONFIG_CHANGE);
+    REQUIRE(project.classifyChange("sample/text/dialogue/1.txt") == Project::SCRIPT_CHANGE);
+    REQUIRE(project.classifyChange("sample/asm/code.asm") == Project::ASM_CHANGE);
+    REQUIRE(project.classifyChange("sample/asm/bin/text/dialogue_0.bin") == Project::NO_CHANGE);
+    REQUIRE(project.classifyChange("roms/test.smc") == Project::ROM_CHANGE);
+    REQUIRE(project.classifyChange("roms/test.sfc") == Project::NO_CHANGE);
+    REQUIRE(project.classifyChange("../elsewhere.txt") == Project::NO_CHANGE);
+}
+
+TEST_CASE("Patched ROMs are ignored in watch mode even if named like the base ROM", "[project]")
+{
+    YAML::Node testNode = YAML::Load(
+                "{\n"
+                "files: {\n"
+                    "mainDir: sample,\n"
+                    "input: {directory: text},\n"
+                    "output: {\n"
+                        "directory: asm, includes: [],\n"
+                        "binaries: {\n"
+                            "mainDir: bin, textDir: text,\n"
+                            "fonts: {dir: fonts, includes: [] }\n"
+                        "}\n"
+                    "},\n"
+                    "romDir: missing_roms\n"
+                "}"
+                ", config: \n"
+                    "{directory: sample, inMapping: text_map.yml},\n"
+                "roms: [{name: test, file: test.sfc, header: false}]"
+                "}"
+                );
+    Project project(testNode, ".");
+    project.setWriteOutput(false);
+    project.setThreadCount(1);
+    REQUIRE(project.classifyChange("missing_roms/test.sfc") == Project::ROM_CHANGE);
+    // The base ROM does not exist, so the build fails, but only after the
+    // files it would have written are known.
+    REQUIRE_THROWS_AS(project.writePatchData(), sable::ASMError);
+    REQUIRE(project.classifyChange("missing_roms/test.sfc") == Project::NO_CHANGE);
+    REQUIRE(project.classifyChange("missing_roms/test.ips") == Project::NO_CHANGE);
+    REQUIRE(project.classifyChange("missing_roms/test.bps") == Project::NO_CHANGE);
+}
+
+TEST_CASE("Every ROM that failed is reported", "[project]")
+{
+    YAML::Node testNode = YAML::Load(
+                "{\n"
+                "files: {\n"
+                    "mainDir: sample,\n"
+                    "input: {directory: text},\n"
+                    "output: {\n"
+                        "directory: asm, includes: [],\n"
+                        "binaries: {\n"
+                            "mainDir: bin, textDir: text,\n"
+                            "fonts: {dir: fonts, includes: [] }\n"
+                        "}\n"
+                    "},\n"
+                    "romDir: missing_roms\n"
+                "}"
+                ", config: \n"
+                    "{directory: sample, inMapping: text_map.yml},\n"
+                "roms: [{name: us, file: us_base.sfc}, {name: jp, file: jp_base.sfc}]"
+                "}"
+                );
+    Project project(testNode, ".");
+    project.setWriteOutput(false);
+    project.setThreadCount(2);
+    std::string error;
+    try {
+        project.writePatchData();
+    } catch (sable::ASMError& e) {
+        error = e.what();
+    }
+    REQUIRE(error.find("us_base.sfc") != std::string::npos);
+    REQUIRE(error.find("jp_base.sfc") != std::string::npos);
+    REQUIRE(error.find("us_base.sfc") < error.find("jp_base.sfc"));
+}
+
+namespace {
+// Writes a project with a text directory per table, each holding a table.txt
+// and a single script, and loads it with output kept in memory.
+Project makeTextProject(const std::string& dir, const std::map<std::string, std::pair<std::string, std::string>>& tables)
+{
+    fs::remove_all(dir);
+    for (auto& table: tables) {
+        fs::path tableDir = fs::path(dir) / "project" / "text" / table.first;
+        fs::create_directories(tableDir);
+        std::ofstream(tableDir / "table.txt") << table.second.first << "file 0.txt\n";
+        std::ofstream(tableDir / "0.txt") << table.second.second;
+    }
+    YAML::Node config = YAML::Load(
+                "{\n"
+                "files: {\n"
+                    "mainDir: project,\n"
+                    "input: {directory: text},\n"
+                    "output: {\n"
+                        "directory: asm,\n"
+                        "binaries: {mainDir: bin, textDir: text, fonts: {dir: fonts, includes: []}}\n"
+                    "},\n"
+                    "romDir: roms\n"
+                "},\n"
+                "config: {inMapping: text_map.yml},\n"
+                "roms: []\n"
+                "}"
+                );
+    config[Project::CONFIG_SECTION][Project::DIR_VAL] = fs::absolute("sample").string();
+    Project project(config, dir);
+    project.setWriteOutput(false);
+    project.setThreadCount(1);
+    return project;
+}
+
+const std::string& outputFile(const Project& project, const std::string& dir, const std::string& file)
+{
+    return project.getOutputFiles().at(fs::absolute(fs::path(dir) / "project" / "asm" / file).string());
+}
+
+// The address of every labelled message, from textDefines.exp.
+std::map<std::string, int> readDefines(const Project& project, const std::string& dir)
+{
+    std::map<std::string, int> defines;
+    std::istringstream input(outputFile(project, dir, "textDefines.exp"));
+    std::string name, equals, value;
+    while (input >> name >> equals >> value) {
+        defines[name.substr(std::string("!def_").size())] = std::stoi(value.substr(1), nullptr, 16);
+    }
+    return defines;
+}
+
+// The bytes of each incbin in text.asm, in order, with its range if it has one.
+std::vector<std::string> readIncbins(const Project& project, const std::string& dir, std::vector<std::pair<size_t, size_t>>* ranges = nullptr)
+{
+    std::vector<std::string> data;
+    std::istringstream input(outputFile(project, dir, "text.asm"));
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.compare(0, 7, "incbin ") != 0) {
+            continue;
+        }
+        std::string path = line.substr(7);
+        size_t colon = path.find(':');
+        const std::string& file = outputFile(project, dir, path.substr(0, colon));
+        if (colon == std::string::npos) {
+            data.push_back(file);
+        } else {
+            size_t dash = path.find('-', colon);
+            size_t start = std::stoul(path.substr(colon + 1, dash - colon - 1), nullptr, 16);
+            size_t end = std::stoul(path.substr(dash + 1), nullptr, 16);
+            if (ranges != nullptr) {
+                ranges->emplace_back(start, end);
+            }
+            data.push_back(file.substr(start, end - start));
+        }
+    }
+    return data;
+}
+}
+
+TEST_CASE("Packed output includes ranges of one file per table", "[project]")
+{
+    // Uppercase letters are one byte and [End] two, so the first message
+    // crosses from bank $A0 into $A1 after 8 bytes.
+    std::string dir = "packed_test";
+    auto tables = std::map<std::string, std::pair<std::string, std::string>>{
+        {"a", {"address $A08000\ndata $A0FFF8\n", "@label split\nABCDEFGHIJKLMNOP[End]\n@label after\nQRS[End]\n"}},
+        {"b", {"address $A28000\ndata $A28100\n", "@label other\nXYZ[End]\n"}}
+    };
+    Project separate = makeTextProject(dir, tables);
+    separate.parseText(nullptr);
+    std::vector<std::string> expected = readIncbins(separate, dir);
+    Project packed = makeTextProject(dir, tables);
+    packed.setPackedOutput(true);
+    packed.parseText(nullptr);
+    std::vector<std::pair<size_t, size_t>> ranges;
+    std::vector<std::string> actual = readIncbins(packed, dir, &ranges);
+    REQUIRE(expected.size() == 4);
+    REQUIRE(actual == expected);
+    REQUIRE(ranges.size() == 4);
+    for (auto& range: ranges) {
+        REQUIRE(range.first < range.second);
+    }
+    SECTION("Both pieces of a message split at a bank boundary are in the blob.")
+    {
+        REQUIRE(actual[0].size() == 8);
+        REQUIRE(actual[1].size() == 10);
+        REQUIRE((ranges[0].second <= ranges[1].first || ranges[1].second <= ranges[0].first));
+        REQUIRE(ranges[0].second <= outputFile(packed, dir, "bin/text/a.bin").size());
+        REQUIRE(ranges[1].second <= outputFile(packed, dir, "bin/text/a.bin").size());
+    }
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Messages are merged into messages that end with them", "[project]")
+{
+    std::string dir = "merge_test";
+    auto build = [&](const std::map<std::string, std::pair<std::string, std::string>>& tables) {
+        Project project = makeTextProject(dir, tables);
+        project.setMergeMessages(true);
+        project.parseText(nullptr);
+        return project;
+    };
+    SECTION("Identical messages share one copy.")
+    {
+        Project project = build({{"a", {"address $A08000\ndata $A08100\n", "@label first\nABC[End]\n@label second\nABC[End]\n"}}});
+        auto defines = readDefines(project, dir);
+        REQUIRE(defines.at("second") == defines.at("first"));
+        REQUIRE(project.getMergedSize() == 5);
+        REQUIRE(readIncbins(project, dir).size() == 1);
+    }
+    SECTION("A message points into the tail of a longer one.")
+    {
+        Project project = build({{"a", {"address $A08000\ndata $A08100\n", "@label host\nXYZABC[End]\n@label tail\nABC[End]\n"}}});
+        auto defines = readDefines(project, dir);
+        REQUIRE(defines.at("host") == 0xA08100);
+        REQUIRE(defines.at("tail") == 0xA08103);
+        REQUIRE(project.getMergedSize() == 5);
+    }
+    SECTION("Messages with an address or printpc keep their own copy.")
+    {
+        Project project = build({{"a", {"address $A08000\ndata $A08100\n",
+                                         "@label host\nXYZABC[End]\n@address $A09000\n@label pinned\nABC[End]\n"
+                                         "@address auto\n@printpc\n@label printed\nYZABC[End]\n"}}});
+        auto defines = readDefines(project, dir);
+        REQUIRE(defines.at("pinned") == 0xA09000);
+        REQUIRE(defines.at("printed") == 0xA09005);
+        REQUIRE(project.getMergedSize() == 0);
+        REQUIRE(readIncbins(project, dir).size() == 3);
+    }
+    SECTION("Text behind 2 byte pointers only merges within its own table.")
+    {
+        Project project = build({
+            {"a", {"address $A08000\ndata $A08100\nwidth 2\n", "@label short\nABC[End]\n@label shortTail\nBC[End]\n"}},
+            {"b", {"address $A18000\ndata $A18100\n", "@label long\nXYZABC[End]\n"}}
+        });
+        auto defines = readDefines(project, dir);
+        REQUIRE(defines.at("short") == 0xA08100);
+        REQUIRE(defines.at("shortTail") == 0xA08101);
+        REQUIRE(defines.at("long") == 0xA18100);
+        REQUIRE(project.getMergedSize() == 4);
+    }
+    SECTION("A tail past the bank split of its host is placed in the second piece.")
+    {
+        // The host is 18 bytes starting 8 bytes before the end of bank $A0,
+        // so the 5 byte tail starts 13 bytes in: 5 bytes into the piece at $A18000.
+        Project project = build({{"a", {"address $A08000\ndata $A0FFF8\n", "@label host\nABCDEFGHIJKLMNOP[End]\n@label tail\nNOP[End]\n"}}});
+        auto defines = readDefines(project, dir);
+        REQUIRE(defines.at("host") == 0xA0FFF8);
+        REQUIRE(defines.at("tail") == 0xA18000 + (13 - 8));
+    }
+    fs::remove_all(dir);
+}
+
+TEST_CASE("ROMs built from a shared patch match ROMs assembled in full", "[project]")
+{
+    std::string dir = "shared_test";
+    fs::remove_all(dir);
+    fs::path mainDir = fs::path(dir) / "project";
+    fs::create_directories(mainDir / "text" / "dialogue");
+    fs::create_directories(mainDir / "asm");
+    fs::create_directories(fs::path(dir) / "roms");
+    std::ofstream(mainDir / "text" / "dialogue" / "table.txt") << "address $A08000\ndata $A08100\nfile 0.txt\n";
+    std::ofstream(mainDir / "text" / "dialogue" / "0.txt") << "@label greeting\nHELLO[End]\n@label farewell\nBYE[End]\n";
+    // The font widths are written where the includes define.
+    std::ofstream(mainDir / "asm" / "code.asm")
+            << "!normalFontWidths = $848000\n!fixedFontWidth = $849000\n"
+            << "ORG $818000\ncode:\ndl greeting\nprint pc\n";
+    std::ofstream(mainDir / "asm" / "us.asm") << "ORG $828000\nregion:\ndb $01\n";
+    std::ofstream(mainDir / "asm" / "jp.asm") << "ORG $828000\nregion:\ndb $02, $03\n";
+    fs::copy_file("sample.sfc", fs::path(dir) / "roms" / "base.sfc");
+    YAML::Node config = YAML::Load(
+                "{\n"
+                "files: {\n"
+                    "mainDir: project,\n"
+                    "input: {directory: text},\n"
+                    "output: {\n"
+                        "directory: asm, includes: [code.asm],\n"
+                        "binaries: {mainDir: bin, textDir: text, fonts: {dir: fonts, includes: []}}\n"
+                    "},\n"
+                    "romDir: roms\n"
+                "},\n"
+                "config: {inMapping: text_map.yml},\n"
+                "roms: [\n"
+                    "{name: us, file: base.sfc, header: false, includes: [us.asm]},\n"
+                    "{name: jp, file: base.sfc, header: false, includes: [jp.asm]}\n"
+                "]\n"
+                "}"
+                );
+    config[Project::CONFIG_SECTION][Project::DIR_VAL] = fs::absolute("sample").string();
+    auto build = [&](bool sharedAssembly) {
+        Project project(config, dir);
+        project.setWriteOutput(false);
+        project.setThreadCount(1);
+        project.setSharedAssembly(sharedAssembly);
+        project.parseText(nullptr);
+        project.writePatchData();
+        std::vector<std::string> roms;
+        for (const char* file: {"us.sfc", "jp.sfc"}) {
+            std::ifstream input(fs::path(dir) / "roms" / file, std::ios::in | std::ios::binary);
+            std::stringstream contents;
+            contents << input.rdbuf();
+            roms.push_back(contents.str());
+        }
+        return roms;
+    };
+    // The trace shows which ROMs were built on top of the shared part
+    // rather than falling back to the full patch.
+    auto usedShared = [](const std::string& events, const std::string& rom) {
+        return std::regex_search(events, std::regex("\"name\":\"useSharedPatch\"[^}]*\"detail\":\"" + rom + "\""));
+    };
+    bool tracing = sable::trace::enabled();
+    sable::trace::start();
+    sable::trace::takeEvents();
+    std::vector<std::string> split = build(true);
+    std::string splitEvents = sable::trace::takeEvents();
+    std::vector<std::string> full = build(false);
+    std::string fullEvents = sable::trace::takeEvents();
+    sable::trace::recording = tracing;
+    REQUIRE(usedShared(splitEvents, "us"));
+    REQUIRE(usedShared(splitEvents, "jp"));
+    REQUIRE(!usedShared(fullEvents, "us"));
+    REQUIRE(!usedShared(fullEvents, "jp"));
+    REQUIRE(!split[0].empty());
+    // Compared as a bool so a failure does not print both ROMs.
+    REQUIRE((split[0] != split[1]));
+    REQUIRE((split[0] == full[0]));
+    REQUIRE((split[1] == full[1]));
+    fs::remove_all(dir);
+}
@@ -1,7 +1,9 @@
 #include <catch2/catch.hpp>
 #include "rompatcher.h"
+#include <algorithm>
 #include <cstring>
 #include <fstream>
+#include "wrapper/filesystem.h"
 
 TEST_CASE("Expansion Test", "[rompatcher]")
 {
@@ -46,6 +48,77 @@ TEST_CASE("Expansion Test", "[rompatcher]")
     }
 }
 
+TEST_CASE("Writing data by SNES address", "[rompatcher]")
+{
+    using sable::RomPatcher;
+    RomPatcher r("sample.sfc", "write test", "lorom", -1);
+    r.expand(sable::util::LoROMToPC(0xE08000));
+    SECTION("Data is written at the mapped location.")
+    {
+        r.writeData(0xE08000, "\x05\x06", 2);
+        REQUIRE(r.atROMAddr(0xE08000) == 5);
+        REQUIRE(r.atROMAddr(0xE08001) == 6);
+    }
+    SECTION("Addresses outside of ROM are rejected.")
+    {
+        REQUIRE_THROWS(r.writeData(0x001000, "\x07", 1));
+    }
+    SECTION("Data past the end of the ROM is rejected.")
+    {
+        REQUIRE_THROWS(r.writeData(0xFFFFFF, "\x01\x02", 2));
+    }
+    SECTION("Every byte that differs from the file is in a changed range.")
+    {
+        r.writeData(0x808000, "\x05\x06\x07", 3);
+        r.writeData(0xE08000, "\x08", 1);
+        RomPatcher base("sample.sfc", "base", "lorom", -1);
+        sable::ByteRanges changed = r.getChangedRanges();
+        int uncovered = 0;
+        for (int i = 0; i < r.getRealSize(); i++) {
+            if (i >= base.getRealSize() || r.at(i) != base.at(i)) {
+                uncovered += std::none_of(changed.begin(), changed.end(), [i](const std::pair<size_t, size_t>& range) {
+                    return range.first <= (size_t)i && (size_t)i < range.second;
+                });
+            }
+        }
+        REQUIRE(uncovered == 0);
+    }
+}
+
+TEST_CASE("Copying and saving ROMs", "[rompatcher]")
+{
+    using sable::RomPatcher;
+    RomPatcher r("sample.sfc", "save test", "lorom", -1);
+    SECTION("A copy does not change the ROM it was made from.")
+    {
+        RomPatcher copy(r);
+        copy.expand(sable::util::LoROMToPC(0xE08000));
+        copy.writeData(0x808000, "\x09", 1);
+        REQUIRE(copy.atROMAddr(0x808000) == 9);
+        REQUIRE(r.atROMAddr(0x808000) != 9);
+        REQUIRE(r.getRomSize() == 131072);
+        REQUIRE(copy.atROMAddr(0xE08000) == 0);
+    }
+    SECTION("A saved ROM replaces the file and can be read back.")
+    {
+        r.expand(sable::util::LoROMToPC(0xE08000));
+        r.writeData(0xE08000, "\x05\x06", 2);
+        {
+            std::ofstream old("save_test.sfc", std::ios::binary);
+            old << "old contents";
+        }
+        REQUIRE(r.save("save_test.sfc"));
+        REQUIRE(!fs::exists("save_test.sfc.tmp"));
+        REQUIRE(fs::file_size("save_test.sfc") == (uintmax_t)r.getRealSize());
+        RomPatcher saved("save_test.sfc", "saved", "lorom", -1);
+        REQUIRE(saved.getRomSize() == r.getRomSize());
+        REQUIRE(saved.atROMAddr(0xE08000) == 5);
+        REQUIRE(saved.atROMAddr(0xE08001) == 6);
+        REQUIRE(memcmp(&saved.at(0), &r.at(0), r.getRealSize()) == 0);
+        fs::remove("save_test.sfc");
+    }
+}
+
 TEST_CASE("Asar patch testing", "[rompatcher]")
 {
     using sable::RomPatcher;
@@ -60,6 +133,34 @@ TEST_CASE("Asar patch testing", "[rompatcher]")
         REQUIRE(r.getMessages(std::back_inserter(msgs)));
         REQUIRE(msgs.empty());
     }
+    SECTION("Test that a patch can be applied from memory files.")
+    {
+        sable::MemoryFiles files;
+        std::string patch = fs::absolute("memory_test.asm").string();
+        files[patch] = "lorom\n\nincsrc memory_data.asm\n";
+        files[fs::absolute("memory_data.asm").string()] = "ORG $E08000\nincbin memory_data.bin\n";
+        files[fs::absolute("memory_data.bin").string()] = std::string("\x03\x04", 2);
+        REQUIRE(!fs::exists("memory_test.asm"));
+        REQUIRE(r.applyPatchFile("memory_test.asm", files) == true);
+        REQUIRE(r.atROMAddr(0xE08000) == 3);
+        REQUIRE(r.atROMAddr(0xE08001) == 4);
+    }
+    SECTION("The result of a patch can be written to another ROM.")
+    {
+        sable::MemoryFiles files;
+        files[fs::absolute("result_test.asm").string()] = "lorom\n\nORG $E08000\nresult:\ndb $09, $0A\nprint \"done\"\n";
+        REQUIRE(r.applyPatchFile("result_test.asm", files) == true);
+        sable::PatchResult result = r.getPatchResult();
+        REQUIRE(result.mapper == Mapper::LOROM);
+        REQUIRE(result.prints == std::vector<std::string>{"done"});
+        REQUIRE(std::count(result.labels.begin(), result.labels.end(), std::make_pair(std::string("result"), 0xE08000)) == 1);
+        RomPatcher other("sample.sfc", "result test", "lorom", -1);
+        REQUIRE(other.writePatchResult(result) == false);
+        other.expand(sable::util::LoROMToPC(0xE08000));
+        REQUIRE(other.writePatchResult(result) == true);
+        REQUIRE(other.atROMAddr(0xE08000) == 9);
+        REQUIRE(other.atROMAddr(0xE08001) == 10);
+    }
     SECTION("Test bad Assar patch.")
     {
         REQUIRE(r.applyPatchFile("bad_test.asm") == false);
@@ -0,0 +1,61 @@
+#include <catch2/catch.hpp>
+#include "server.h"
+#include <fstream>
+#include <stdexcept>
+#include "wrapper/filesystem.h"
+#ifndef _WIN32
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+TEST_CASE("Build server requests", "[server]")
+{
+    SECTION("Frames keep their length across a socket.")
+    {
+        int fds[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        std::string sent = "{\"command\":\"parse\",\"project\":\"sample\"}";
+        REQUIRE(sable::BuildServer::writeFrame(fds[0], sent));
+        REQUIRE(sable::BuildServer::writeFrame(fds[0], ""));
+        close(fds[0]);
+        std::string received;
+        REQUIRE(sable::BuildServer::readFrame(fds[1], received));
+        REQUIRE(received == sent);
+        REQUIRE(sable::BuildServer::readFrame(fds[1], received));
+        REQUIRE(received.empty());
+        REQUIRE(!sable::BuildServer::readFrame(fds[1], received));
+        close(fds[1]);
+    }
+    SECTION("Bad requests are answered with an error.")
+    {
+        sable::BuildServer server("server_test.sock", 1);
+        REQUIRE(server.handleRequest("[1, 2]") == "{\"ok\":false,\"error\":\"Request must be an object with a \\\"command\\\".\"}");
+        REQUIRE(server.handleRequest("{\"command\":\"build\"}") == "{\"ok\":false,\"error\":\"Request must name a \\\"project\\\" directory.\"}");
+        REQUIRE(server.handleRequest("{\"command\":\"unknown\"}").find("\"ok\":false") != std::string::npos);
+        REQUIRE(server.handleRequest("{\"command\":\"parse\",\"project\":\"missing\"}").find("config.yml not found") != std::string::npos);
+        REQUIRE(server.handleRequest("{\"command\":\"shutdown\"}") == "{\"ok\":true}");
+    }
+    SECTION("Only a socket that nothing listens on is replaced.")
+    {
+        {
+            sable::BuildServer server("server_test.sock", 1);
+            REQUIRE_THROWS_AS(sable::BuildServer("server_test.sock", 1), std::runtime_error);
+        }
+        // Left behind as if the server had not shut down cleanly.
+        int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, "server_test.sock", sizeof (address.sun_path) - 1);
+        REQUIRE(bind(stale, reinterpret_cast<sockaddr*>(&address), sizeof (address)) == 0);
+        close(stale);
+        {
+            sable::BuildServer server("server_test.sock", 1);
+        }
+        std::ofstream("server_test.sock") << "not a socket";
+        REQUIRE_THROWS_AS(sable::BuildServer("server_test.sock", 1), std::runtime_error);
+        REQUIRE(fs::exists("server_test.sock"));
+        fs::remove("server_test.sock");
+    }
+}
+#endif
@@ -0,0 +1,86 @@
+#include <catch2/catch.hpp>
+#include <fstream>
+#include "parse.h"
+#include "project.h"
+#include "stats.h"
+#include "wrapper/filesystem.h"
+
+TEST_CASE("Build statistics", "[stats]")
+{
+    sable::TextParser p(YAML::LoadFile("sample/text_map.yml"), "normal");
+    std::vector<unsigned char> data;
+    auto settings = p.getDefaultSetting(0x808000);
+    bool counting = sable::stats::enabled();
+    sable::stats::start();
+    sable::stats::collect();
+    SECTION("Parsing a line counts what it encoded.")
+    {
+        p.parseLine("@label counted", 'H', settings, std::back_inserter(data));
+        p.parseLine("Hello[Marth]❤[Bullet][01][End]", std::char_traits<char>::eof(), settings, std::back_inserter(data));
+        sable::stats::Totals totals = sable::stats::collect();
+        REQUIRE(totals.values[sable::stats::DIRECTIVES] == 1);
+        REQUIRE(totals.values[sable::stats::CHARACTERS] == 7);
+        REQUIRE(totals.byKey[sable::stats::CHARACTERS].at("normal") == 7);
+        REQUIRE(totals.values[sable::stats::DIGRAPHS] == 1);
+        REQUIRE(totals.values[sable::stats::EXTRAS] == 1);
+        REQUIRE(totals.values[sable::stats::COMMANDS] == 2);
+    }
+    SECTION("Collecting sets the counters back to zero.")
+    {
+        sable::stats::add(sable::stats::BYTES_WRITTEN, "table", 12);
+        REQUIRE(sable::stats::collect().byKey[sable::stats::BYTES_WRITTEN].at("table") == 12);
+        REQUIRE(sable::stats::collect().values[sable::stats::BYTES_WRITTEN] == 0);
+    }
+    SECTION("Counters are printed as JSON.")
+    {
+        sable::stats::add(sable::stats::BYTES_WRITTEN, "table", 12);
+        std::string json = sable::stats::formatJson(sable::stats::collect());
+        REQUIRE(json.find("\"bytesWritten\":12,\"bytesWrittenByTable\":{\"table\":12}") != std::string::npos);
+        REQUIRE(json.front() == '{');
+        REQUIRE(json.back() == '}');
+    }
+    sable::stats::counting = counting;
+}
+
+TEST_CASE("Finding a dictionary is not counted as encoding", "[stats]")
+{
+    std::string dir = "stats_test";
+    fs::remove_all(dir);
+    fs::create_directories(fs::path(dir) / "config");
+    fs::create_directories(fs::path(dir) / "project" / "text" / "dialogue");
+    YAML::Node map = YAML::LoadFile("sample/text_map.yml");
+    map["normal"][sable::Font::DICTIONARY] = YAML::Load("{address: $8A8000, codes: [0x54, 0x5F], length: 4}");
+    std::ofstream(fs::path(dir) / "config" / "text_map.yml") << map;
+    std::ofstream(fs::path(dir) / "project" / "text" / "dialogue" / "table.txt") << "address $A08000\ndata $A08100\nfile 0.txt\n";
+    std::ofstream(fs::path(dir) / "project" / "text" / "dialogue" / "0.txt") << "HELLO HELLO HELLO[End]\n";
+    YAML::Node config = YAML::Load(
+                "{\n"
+                "files: {\n"
+                    "mainDir: project,\n"
+                    "input: {directory: text},\n"
+                    "output: {\n"
+                        "directory: asm,\n"
+                        "binaries: {mainDir: bin, textDir: text, fonts: {dir: fonts, includes: []}}\n"
+                    "},\n"
+                    "romDir: roms\n"
+                "},\n"
+                "config: {inMapping: text_map.yml},\n"
+                "roms: []\n"
+                "}"
+                );
+    config[sable::Project::CONFIG_SECTION][sable::Project::DIR_VAL] = fs::absolute(fs::path(dir) / "config").string();
+    sable::Project project(config, dir);
+    project.setWriteOutput(false);
+    project.setThreadCount(1);
+    bool counting = sable::stats::enabled();
+    sable::stats::start();
+    sable::stats::collect();
+    project.parseText(nullptr);
+    sable::stats::Totals totals = sable::stats::collect();
+    sable::stats::counting = counting;
+    REQUIRE(totals.values[sable::stats::FILES_OPENED] == 2);
+    REQUIRE(totals.values[sable::stats::CHARACTERS] == 17);
+    REQUIRE(totals.byKey[sable::stats::CHARACTERS].at("normal") == 17);
+    REQUIRE(totals.values[sable::stats::COMMANDS] == 1);
+    fs::remove_all(dir);
+}
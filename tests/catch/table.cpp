@@ -143,6 +143,11 @@ TEST_CASE("Loading data from stream", "[table]")
         input.str("savewidth ");
         t.getDataFromFile(input);
         REQUIRE(t.getStoreWidths());
+        input.clear();
+        input.str("data freespace\nnobankcross");
+        t.getDataFromFile(input);
+        REQUIRE(t.getUseFreeSpace());
+        REQUIRE(t.getNoBankCross());
     }
 }
 
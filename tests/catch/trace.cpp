@@ -0,0 +1,43 @@
+#include <catch2/catch.hpp>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "trace.h"
+
+TEST_CASE("Trace spans", "[trace]")
+{
+    sable::trace::takeEvents();
+    SECTION("Nothing is recorded before tracing starts.")
+    {
+        if (!sable::trace::enabled()) {
+            {
+                sable::trace::Span span("ignored");
+            }
+            REQUIRE(sable::trace::takeEvents().empty());
+        }
+    }
+    SECTION("Spans from each thread are written as complete events.")
+    {
+        sable::trace::start();
+        {
+            sable::trace::Span span("outer", "a \"quoted\" detail");
+            std::thread([]() {
+                sable::trace::Span span("inner");
+            }).join();
+        }
+        REQUIRE(sable::trace::write("trace_test.json"));
+        std::ifstream input("trace_test.json");
+        std::stringstream contents;
+        contents << input.rdbuf();
+        std::string json = contents.str();
+        REQUIRE(json.find("\"name\":\"outer\"") != std::string::npos);
+        REQUIRE(json.find("\"name\":\"inner\"") != std::string::npos);
+        REQUIRE(json.find("\"args\":{\"detail\":\"a \\\"quoted\\\" detail\"}") != std::string::npos);
+        REQUIRE(json.find(",]") == std::string::npos);
+        size_t outerTid = json.find("\"tid\":", json.find("\"name\":\"outer\""));
+        size_t innerTid = json.find("\"tid\":", json.find("\"name\":\"inner\""));
+        REQUIRE(json.substr(outerTid, json.find(',', outerTid) - outerTid) != json.substr(innerTid, json.find(',', innerTid) - innerTid));
+        // Written spans stay recorded for the next write.
+        REQUIRE(sable::trace::takeEvents().find("\"name\":\"outer\"") != std::string::npos);
+    }
+}
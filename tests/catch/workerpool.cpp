@@ -0,0 +1,35 @@
+#include <catch2/catch.hpp>
+#include "workerpool.h"
+
+TEST_CASE("Worker pool results", "[workerpool]")
+{
+    auto task = [](const std::vector<size_t>& indices) {
+        std::vector<std::string> output;
+        for (size_t index: indices) {
+            output.push_back("result " + std::to_string(index));
+        }
+        return output;
+    };
+    SECTION("Results come back in index order from several workers.")
+    {
+        std::vector<std::string> results = sable::runWorkers(5, 3, task);
+        REQUIRE(results.size() == 5);
+        for (size_t i = 0; i < results.size(); i++) {
+            REQUIRE(results[i] == "result " + std::to_string(i));
+        }
+    }
+    SECTION("A single worker runs in the calling process.")
+    {
+        int calls = 0;
+        std::vector<std::string> results = sable::runWorkers(2, 1, [&](const std::vector<size_t>& indices) {
+            calls++;
+            return task(indices);
+        });
+        REQUIRE(calls == 1);
+        REQUIRE(results.back() == "result 1");
+    }
+    SECTION("Nothing to do returns no results.")
+    {
+        REQUIRE(sable::runWorkers(0, 4, task).empty());
+    }
+}